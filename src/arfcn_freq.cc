@@ -80,6 +80,75 @@ int str_to_bi(char *s) {
 }
 
 
+/*
+ * Parses a comma-separated list of band indicators, or "all", into bi.
+ * Returns the number of bands or -1 if one isn't recognized.
+ */
+int str_to_bi_list(char *s, int *bi, int bi_max) {
+
+	static const int all[] = {GSM_850, GSM_E_900, DCS_1800, PCS_1900};
+	char buf[BUFSIZ], *tok, *save;
+	int n = 0, b, i;
+
+	if(!strcmp(s, "all") || !strcmp(s, "ALL")) {
+		for(n = 0; (n < bi_max) && (n < (int)(sizeof(all) / sizeof(*all))); n++)
+			bi[n] = all[n];
+		return n;
+	}
+
+	strncpy(buf, s, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(0, ",", &save)) {
+		if((b = str_to_bi(tok)) == -1)
+			return -1;
+		for(i = 0; (i < n) && (bi[i] != b); i++);
+		if((i == n) && (n < bi_max))
+			bi[n++] = b;
+	}
+
+	return n? n : -1;
+}
+
+
+/*
+ * Marks the channels in s, a list like "512-540,600", in set, which has
+ * room for ARFCN_COUNT.  Returns how many there are, or -1 if s isn't a
+ * channel list.
+ */
+int str_to_arfcn_set(const char *s, char *set) {
+
+	const char *p = s;
+	char *end;
+	long lo, hi, i;
+	int n = 0;
+
+	memset(set, 0, ARFCN_COUNT);
+	while(*p) {
+		lo = hi = strtol(p, &end, 10);
+		if((end == p) || (lo < 0) || (lo >= ARFCN_COUNT))
+			return -1;
+		if(*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+			if((end == p) || (hi < lo) || (hi >= ARFCN_COUNT))
+				return -1;
+		}
+		for(i = lo; i <= hi; i++) {
+			if(!set[i])
+				n++;
+			set[i] = 1;
+		}
+		p = end;
+		if(*p == ',')
+			p++;
+		else if(*p)
+			return -1;
+	}
+
+	return n? n : -1;
+}
+
+
 double arfcn_to_freq(int n, int *bi) {
 
 	if((128 <= n) && (n <= 251)) {
@@ -25,17 +25,24 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#pragma once
+
 enum {
 	BI_NOT_DEFINED,
 	GSM_850,
 	GSM_900,
 	GSM_E_900,
 	DCS_1800,
-	PCS_1900
+	PCS_1900,
+	BI_COUNT
 };
 
+static const int ARFCN_COUNT = 1024;
+
 const char *bi_to_str(int bi);
 int str_to_bi(char *s);
+int str_to_bi_list(char *s, int *bi, int bi_max);
+int str_to_arfcn_set(const char *s, char *set);
 double arfcn_to_freq(int n, int *bi = 0);
 int freq_to_arfcn(double freq, int *bi = 0);
 int first_chan(int bi);
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "file_source.h"
+#include "fcch_detector.h"
+#include "offset.h"
+#include "batch.h"
+
+extern int g_verbosity;
+
+
+struct batch_result {
+	int			ok;
+	unsigned long long	samples;
+	offset_result		m;
+};
+
+
+struct batch_job {
+	std::vector<std::string>	files;
+	std::string			args;
+	float				sample_rate;
+	double				output_rate;
+	FILE *				out;
+	int				json;
+
+	pthread_mutex_t			mutex;	// next, out and failed
+	unsigned int			next,
+					failed;	// recordings not read
+};
+
+
+/*
+ * Scans the recording the device was just pointed at from start to end,
+ * or until as many bursts as offset_detect() averages have been measured.
+ */
+static void measure(file_source *u, fcch_detector *l, batch_result *res) {
+
+	res->samples = u->remaining();
+	if(!offset_measure(u, l, 0, 0.0, 0.0, 0, 1, &res->m))
+		res->ok = 1;
+}
+
+
+static void json_string(FILE *fp, const char *s) {
+
+	fputc('"', fp);
+	for(; *s; s++) {
+		if((*s == '"') || (*s == '\\'))
+			fprintf(fp, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			fprintf(fp, "\\u%04x", *s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+
+static void csv_string(FILE *fp, const char *s) {
+
+	if(!strpbrk(s, ",\"\n")) {
+		fputs(s, fp);
+		return;
+	}
+	fputc('"', fp);
+	for(; *s; s++) {
+		if(*s == '"')
+			fputc('"', fp);
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+
+static void report(batch_job *job, const char *path, const batch_result *res) {
+
+	FILE *fp = job->out;
+
+	if(job->json) {
+		fprintf(fp, "{\"file\": ");
+		json_string(fp, path);
+		if(!res->ok) {
+			fprintf(fp, ", \"status\": \"error\"}\n");
+			return;
+		}
+		fprintf(fp, ", \"status\": \"ok\", \"samples\": %llu, \"bursts\": "
+		   "%u, \"not_found\": %d, \"power\": %.2lf, \"c0\": %s",
+		   res->samples, res->m.count, res->m.notfound, res->m.power,
+		   res->m.count? "true" : "false");
+		if(res->m.count) {
+			fprintf(fp, ", \"offset\": %.2f, \"stddev\": %.2f, "
+			   "\"min\": %.2f, \"max\": %.2f", res->m.offset,
+			   res->m.stddev, res->m.min, res->m.max);
+		}
+		fprintf(fp, "}\n");
+		return;
+	}
+
+	csv_string(fp, path);
+	if(!res->ok) {
+		fprintf(fp, ",error,,,,,,,,,\n");
+		return;
+	}
+	fprintf(fp, ",ok,%llu,%u,%d,%.2lf,%d,", res->samples, res->m.count,
+	   res->m.notfound, res->m.power, res->m.count? 1 : 0);
+	if(res->m.count) {
+		fprintf(fp, "%.2f,%.2f,%.2f,%.2f\n", res->m.offset, res->m.stddev,
+		   res->m.min, res->m.max);
+	} else
+		fprintf(fp, ",,,\n");
+}
+
+
+static void *worker(void *arg) {
+
+	batch_job *job = (batch_job *)arg;
+	file_source *u;
+	fcch_detector *l = 0;
+	batch_result res;
+	unsigned int i;
+
+	u = new file_source(job->sample_rate, job->args);
+	if(job->output_rate > 0.0)
+		u->set_output_rate(job->output_rate);
+
+	for(;;) {
+		pthread_mutex_lock(&job->mutex);
+		i = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+		if(i >= job->files.size())
+			break;
+
+		memset(&res, 0, sizeof(res));
+		if(!u->replay(job->files[i])) {
+			if(!l)
+				l = new fcch_detector(u->sample_rate());
+			else
+				l->reset();
+			measure(u, l, &res);
+		}
+
+		if(g_verbosity > 0) {
+			fprintf(stderr, "%s: %u bursts\n", job->files[i].c_str(),
+			   res.m.count);
+		}
+
+		pthread_mutex_lock(&job->mutex);
+		report(job, job->files[i].c_str(), &res);
+		fflush(job->out);
+		if(!res.ok)
+			job->failed++;
+		pthread_mutex_unlock(&job->mutex);
+	}
+
+	delete l;
+	delete u;
+
+	return 0;
+}
+
+
+/*
+ * The recordings named by source, a directory or a list.
+ */
+static int find_files(const char *source, std::vector<std::string> &files) {
+
+	char buf[BUFSIZ], *p;
+	struct stat st;
+	struct dirent *de;
+	DIR *dir;
+	FILE *fp;
+	std::string path;
+
+	if((!strcmp(source, "-")) || stat(source, &st) || (!S_ISDIR(st.st_mode))) {
+		if(!strcmp(source, "-"))
+			fp = stdin;
+		else if(!(fp = fopen(source, "r"))) {
+			fprintf(stderr, "error: batch: %s: %s\n", source,
+			   strerror(errno));
+			return -1;
+		}
+		while(fgets(buf, sizeof(buf), fp)) {
+			if((p = strpbrk(buf, "\r\n")))
+				*p = 0;
+			if(*buf && (*buf != '#'))
+				files.push_back(buf);
+		}
+		if(fp != stdin)
+			fclose(fp);
+		return 0;
+	}
+
+	if(!(dir = opendir(source))) {
+		fprintf(stderr, "error: batch: %s: %s\n", source, strerror(errno));
+		return -1;
+	}
+	while((de = readdir(dir))) {
+		if(de->d_name[0] == '.')
+			continue;
+		path = std::string(source) + "/" + de->d_name;
+		if((!stat(path.c_str(), &st)) && S_ISREG(st.st_mode))
+			files.push_back(path);
+	}
+	closedir(dir);
+	std::sort(files.begin(), files.end());
+
+	return 0;
+}
+
+
+/*
+ * Analyzes every recording in source with threads workers, or one per
+ * CPU if threads is 0, writing results to out or stdout.  A recording that
+ * can't be read is reported as an error and the rest are still analyzed,
+ * but then -1 is returned.
+ */
+int batch_run(const char *source, const char *dev_args, float sample_rate,
+   double output_rate, const char *out, unsigned int threads) {
+
+	batch_job job;
+	std::vector<pthread_t> tids;
+	pthread_t tid;
+	unsigned int i;
+	size_t len;
+	long n;
+	int r;
+
+	if(find_files(source, job.files))
+		return -1;
+	if(job.files.empty()) {
+		fprintf(stderr, "error: batch: no recordings in %s\n", source);
+		return -1;
+	}
+
+	// the path is set for each recording, the end of one is the end
+	job.args = std::string("loop=0,") + dev_args;
+	job.sample_rate = sample_rate;
+	job.output_rate = output_rate;
+	job.next = 0;
+	job.failed = 0;
+	job.json = 0;
+	job.out = stdout;
+	if(out) {
+		len = strlen(out);
+		job.json = ((len > 5) && (!strcmp(out + len - 5, ".json"))) ||
+		   ((len > 6) && (!strcmp(out + len - 6, ".jsonl")));
+		if(!(job.out = fopen(out, "w"))) {
+			fprintf(stderr, "error: batch: %s: %s\n", out,
+			   strerror(errno));
+			return -1;
+		}
+	}
+	if(!job.json) {
+		fprintf(job.out, "file,status,samples,bursts,not_found,power,c0,"
+		   "offset,stddev,min,max\n");
+	}
+	pthread_mutex_init(&job.mutex, 0);
+
+	if(!threads) {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (n > 0)? n : 1;
+	}
+	if(threads > job.files.size())
+		threads = job.files.size();
+
+	// every thread has a CPU already, compact recordings are decoded in line
+	if(threads > 1)
+		job.args = std::string("decoders=0,") + job.args;
+
+	if(g_verbosity > 0) {
+		fprintf(stderr, "batch: %u recordings, %u threads\n",
+		   (unsigned int)job.files.size(), threads);
+	}
+
+	for(i = 1; i < threads; i++) {
+		if((r = pthread_create(&tid, 0, worker, &job))) {
+			fprintf(stderr, "error: batch: pthread_create: %s\n",
+			   strerror(r));
+			break;
+		}
+		tids.push_back(tid);
+	}
+	worker(&job);
+	for(i = 0; i < tids.size(); i++)
+		pthread_join(tids[i], 0);
+
+	pthread_mutex_destroy(&job.mutex);
+	if(job.out != stdout)
+		fclose(job.out);
+
+	if(job.failed) {
+		fprintf(stderr, "error: batch: %u of %u recordings failed\n",
+		   job.failed, (unsigned int)job.files.size());
+		return -1;
+	}
+
+	return 0;
+}
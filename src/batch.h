@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * batch
+ *
+ * Offline analysis of a set of recordings, as made on drive tests.  Each
+ * recording is taken to be one channel and is scanned from start to end
+ * for FCCH bursts, up to the number offset_detect() averages.  Whether any
+ * were found says whether the channel is a C0 carrier, and their trimmed
+ * mean is the offset.
+ *
+ * That is the FCCH half of c0_detect().  Its power half only picks which
+ * channels of a band are worth searching, against a noise floor taken over
+ * the band, and a set of recordings isn't a band: it may mix bands and
+ * sites, and every recording is searched anyway.  The power of each is
+ * written out so a floor can be applied afterwards.
+ *
+ * Recordings are given as a directory, every file in which is read, or as
+ * a file listing one path per line ("-" reads the list from stdin).  They
+ * must all share a format and rate, given with the usual file device
+ * arguments less the file name, e.g. -u rate=1e6,format=fc32.
+ *
+ * Recordings are shared out among worker threads as each becomes free.
+ * Each worker keeps one file device and one detector for all the
+ * recordings it handles, so every file is mapped once and FFTW plans once
+ * per thread.  A line of results is written per recording as it finishes:
+ * CSV, or JSON lines if the output file name ends in .json or .jsonl.
+ */
+
+#pragma once
+
+int batch_run(const char *source, const char *dev_args, float sample_rate,
+   double output_rate, const char *out, unsigned int threads);
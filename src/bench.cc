@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kal_bench
+ *
+ * Microbenchmarks for the DSP and buffer hot paths, built and run with
+ * "make bench".  The input is a gsm_synth carrier (FCCH, SCH and random
+ * bursts plus noise) with a fixed seed, so every run sees the same samples.
+ * Each benchmark is repeated and the fastest repetition is reported, in
+ * ns per sample and samples per second.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "usrp_complex.h"
+#include "circular_buffer.h"
+#include "fcch_detector.h"
+#include "peak_detect.h"
+#include "gsm_synth.h"
+#include "util.h"
+
+int g_verbosity = 0;
+int g_debug = 0;
+int g_profile = 0;
+
+static const unsigned int FFT_SIZE = 1024;
+static const unsigned int BURST_LEN = 148;
+
+static float g_rate;
+static unsigned int g_len, g_burst;
+static complex *g_signal, *g_out, *g_spectrum;
+static short *g_sc16;
+static fcch_detector *g_l;
+static circular_buffer *g_cb;
+static volatile float g_sink;
+
+
+static double now() {
+
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ * Runs f repeat times and reports the fastest.  f returns the number of
+ * samples it processed.
+ */
+static void run(const char *name, unsigned int (*f)(), unsigned int repeat) {
+
+	unsigned int i, n = 0;
+	double t, best = -1.0;
+
+	for(i = 0; i < repeat; i++) {
+		t = now();
+		n = f();
+		t = now() - t;
+		if((best < 0.0) || (t < best))
+			best = t;
+	}
+
+	if(best <= 0.0)
+		best = 1e-6;
+	printf("%-20s %10u %10.2f %12.0f\n", name, n, best * 1e9 / n, n / best);
+}
+
+
+/*
+ * The adaptive filter one sample at a time, as scan() used to run it.
+ */
+static unsigned int bench_next_norm_error() {
+
+	unsigned int i;
+	float e;
+
+	g_l->reset();
+	for(i = 0; i < g_len; i++) {
+		g_l->update(g_signal + i, 1);
+		if(!g_l->next_norm_error(&e))
+			g_sink = e;
+	}
+
+	return g_len;
+}
+
+
+static unsigned int bench_scan() {
+
+	float offset;
+	unsigned int consumed;
+
+	if(!g_l->scan(g_signal, g_len, &offset, &consumed))
+		fprintf(stderr, "warning: scan found no FCCH\n");
+	g_sink = offset;
+
+	return g_len;
+}
+
+
+/*
+ * The same filter over whole blocks, as scan() runs it now, for comparison
+ * with bench_next_norm_error.
+ */
+static unsigned int bench_filter_block() {
+
+	unsigned int len = 0;
+
+	g_l->reset();
+	while(len < g_len) {
+		len += g_l->update(g_signal + len, g_len - len);
+		g_sink = g_l->filter_block();
+	}
+
+	return g_len;
+}
+
+
+static unsigned int bench_freq_detect() {
+
+	static const unsigned int COUNT = 100;
+
+	unsigned int i;
+	float pm;
+
+	for(i = 0; i < COUNT; i++)
+		g_sink = g_l->freq_detect(g_signal + i * g_burst, g_burst, &pm);
+
+	return COUNT * g_burst;
+}
+
+
+static unsigned int bench_peak_detect() {
+
+	static const unsigned int COUNT = 100;
+
+	unsigned int i;
+	float avg_power;
+	complex peak;
+
+	for(i = 0; i < COUNT; i++)
+		g_sink = peak_detect(g_spectrum + (i % 4) * FFT_SIZE, FFT_SIZE,
+		   &peak, &avg_power);
+
+	return COUNT * FFT_SIZE;
+}
+
+
+static unsigned int bench_interpolate_point() {
+
+	static const unsigned int COUNT = 100000;
+
+	unsigned int i;
+	complex p = 0.0;
+
+	for(i = 0; i < COUNT; i++)
+		p += interpolate_point(g_signal, g_len, 20.0 + (i % 1000) * 1.37);
+	g_sink = p.real();
+
+	return COUNT;
+}
+
+
+static unsigned int bench_sc16_to_fc32() {
+
+	sc16_to_fc32(g_sc16, g_out, g_len);
+	g_sink = g_out[g_len - 1].real();
+
+	return g_len;
+}
+
+
+/*
+ * Packet-sized writes and detector-sized peek/purge, as in the capture
+ * path.
+ */
+static unsigned int bench_circular_buffer() {
+
+	static const unsigned int PACKET = 363, CHUNK = 1000;
+
+	unsigned int i, len;
+
+	g_cb->flush();
+	for(i = 0; i + PACKET <= g_len; i += PACKET) {
+		g_cb->write(g_signal + i, PACKET);
+		while(g_cb->data_available() >= CHUNK) {
+			g_sink = ((complex *)g_cb->peek(&len))->real();
+			g_cb->purge(CHUNK);
+		}
+	}
+
+	return i;
+}
+
+
+static void usage(char *prog) {
+
+	printf("Usage: %s [-s samples per symbol] [-n repeat]\n", prog);
+	exit(-1);
+}
+
+
+int main(int argc, char **argv) {
+
+	int c;
+	unsigned int i, repeat = 5;
+	float sps = 1.0;
+	gsm_synth *synth;
+
+	while((c = getopt(argc, argv, "s:n:h?")) != EOF) {
+		switch(c) {
+			case 's':
+				sps = strtod(optarg, 0);
+				if(sps < 1.0)
+					usage(argv[0]);
+				break;
+
+			case 'n':
+				repeat = strtoul(optarg, 0, 0);
+				if(!repeat)
+					usage(argv[0]);
+				break;
+
+			default:
+				usage(argv[0]);
+				break;
+		}
+	}
+
+	// 12 frames, what offset.cc and c0_detect.cc scan at a time
+	g_rate = GSM_RATE * sps;
+	g_len = (unsigned int)ceil((12 * 8 * 156.25 + 156.25) * sps);
+	g_burst = (unsigned int)(BURST_LEN * sps);
+
+	g_signal = new complex[g_len];
+	g_out = new complex[g_len];
+	g_sc16 = new short[2 * g_len];
+	g_spectrum = new complex[4 * FFT_SIZE];
+
+	synth = new gsm_synth(g_rate, 2345.0, 15.0);
+	synth->generate(g_signal, g_len, 0);
+	for(i = 0; i < g_len; i++) {
+		g_sc16[2 * i] = (short)g_signal[i].real();
+		g_sc16[2 * i + 1] = (short)g_signal[i].imag();
+	}
+
+	// tone plus noise, as peak_detect sees after the FFT of an FCCH
+	synth->set_carrier(false);
+	synth->generate(g_spectrum, 4 * FFT_SIZE, 0);
+	for(i = 0; i < 4; i++)
+		g_spectrum[i * FFT_SIZE + 100 + 37 * i] += complex(20000.0, 0.0);
+
+	g_l = new fcch_detector(g_rate);
+	g_cb = new circular_buffer(1 << 20, sizeof(complex), 0);
+
+	printf("sample rate %.2f, %u samples, best of %u\n", g_rate, g_len,
+	   repeat);
+	printf("%-20s %10s %10s %12s\n", "benchmark", "samples", "ns/sample",
+	   "samples/s");
+	run("next_norm_error", bench_next_norm_error, repeat);
+	run("filter_block", bench_filter_block, repeat);
+	run("scan", bench_scan, repeat);
+	run("freq_detect", bench_freq_detect, repeat);
+	run("peak_detect", bench_peak_detect, repeat);
+	run("interpolate_point", bench_interpolate_point, repeat);
+	run("sc16_to_fc32", bench_sc16_to_fc32, repeat);
+	run("circular_buffer", bench_circular_buffer, repeat);
+
+	delete g_cb;
+	delete g_l;
+	delete synth;
+	delete[] g_spectrum;
+	delete[] g_sc16;
+	delete[] g_out;
+	delete[] g_signal;
+
+	return 0;
+}
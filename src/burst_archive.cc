@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "burst_archive.h"
+#include "util.h"
+
+static const char MAGIC[4] = { 'K', 'A', 'L', 'B' };
+
+
+burst_archive::burst_archive(const char *path) {
+
+	m_path = strdup(path);
+	m_fp = 0;
+	m_buf = 0;
+	m_buf_len = 0;
+	m_out = 0;
+	m_out_len = 0;
+	pthread_mutex_init(&m_mutex, 0);
+}
+
+
+burst_archive::~burst_archive() {
+
+	if(m_fp)
+		fclose(m_fp);
+	delete[] m_buf;
+	delete[] m_out;
+	free(m_path);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+
+/*
+ * Opens the archive to add to it, creating it if need be, or to read it
+ * from the start.
+ */
+int burst_archive::open(bool append) {
+
+	if(!(m_fp = fopen(m_path, append? "a+b" : "rb"))) {
+		fprintf(stderr, "error: burst_archive: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+
+	return append? recover() : 0;
+}
+
+
+/*
+ * Walks the records already in the archive and cuts off a last one left
+ * incomplete by a crash, so that what is appended after it can be read
+ * back.  Returns -1 if a record before the end is bad.
+ */
+int burst_archive::recover() {
+
+	burst_record rec;
+	struct stat st;
+	off_t end = 0, next;
+
+	if(fstat(fileno(m_fp), &st)) {
+		fprintf(stderr, "error: burst_archive: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+
+	while(end + (off_t)sizeof(rec) <= st.st_size) {
+		if(fseeko(m_fp, end, SEEK_SET) ||
+		   (fread(&rec, sizeof(rec), 1, m_fp) != 1)) {
+			fprintf(stderr, "error: burst_archive: %s: %s\n",
+			   m_path, strerror(errno));
+			return -1;
+		}
+		if(memcmp(rec.magic, MAGIC, sizeof(rec.magic))) {
+			fprintf(stderr, "error: burst_archive: %s: bad record "
+			   "at %lld\n", m_path, (long long)end);
+			return -1;
+		}
+		next = end + sizeof(rec) + (off_t)rec.len * 2 * sizeof(short);
+		if(next > st.st_size)
+			break;
+		end = next;
+	}
+
+	if(end < st.st_size) {
+		fprintf(stderr, "warning: burst_archive: %s: dropping an "
+		   "incomplete record at %lld\n", m_path, (long long)end);
+		if(ftruncate(fileno(m_fp), end)) {
+			fprintf(stderr, "error: burst_archive: %s: %s\n",
+			   m_path, strerror(errno));
+			return -1;
+		}
+	}
+
+	// switching from reading to writing takes a seek
+	return fseeko(m_fp, 0, SEEK_END)? -1 : 0;
+}
+
+
+/*
+ * Appends the len samples at start in s that an offset was measured from,
+ * with GUARD symbols either side where s has them.  The carrier is at freq
+ * on channel chan of band bi.  when is the device time of s[0], or
+ * negative if it isn't known.  Returns -1 if the write failed.
+ */
+int burst_archive::add(const complex *s, unsigned int s_len, float start,
+   unsigned int len, float rate, double freq, int chan, int bi, double when,
+   float offset, float pm) {
+
+	unsigned int first, last, n, i,
+	   guard = (unsigned int)ceil(GUARD * rate / GSM_RATE);
+	float max = 0.0, scale;
+	int r = 0;
+	burst_record rec;
+	struct timeval tv;
+
+	if(start >= s_len)
+		return 0;
+	first = (start > guard)? (unsigned int)start - guard : 0;
+	last = (unsigned int)ceil(start) + len + guard;
+	if(last > s_len)
+		last = s_len;
+	if(first >= last)
+		return 0;
+	n = last - first;
+
+	for(i = first; i < last; i++) {
+		if(fabs(s[i].real()) > max)
+			max = fabs(s[i].real());
+		if(fabs(s[i].imag()) > max)
+			max = fabs(s[i].imag());
+	}
+	scale = (max > 0.0)? max / 32767.0 : 1.0;
+
+	memset(&rec, 0, sizeof(rec));
+	memcpy(rec.magic, MAGIC, sizeof(rec.magic));
+	rec.len = n;
+	rec.chan = chan;
+	rec.bi = bi;
+	rec.start = (unsigned int)start - first;
+	rec.burst = (rec.start + len > n)? n - rec.start : len;
+	rec.rate = rate;
+	rec.offset = offset;
+	rec.pm = pm;
+	rec.scale = scale;
+	rec.freq = freq;
+	rec.when = (when < 0.0)? -1.0 : when + first / rate;
+	gettimeofday(&tv, 0);
+	rec.wall = tv.tv_sec + tv.tv_usec / 1e6;
+
+	pthread_mutex_lock(&m_mutex);
+	if(m_buf_len < 2 * n) {
+		delete[] m_buf;
+		m_buf_len = 2 * n;
+		m_buf = new short[m_buf_len];
+	}
+	for(i = 0; i < n; i++) {
+		m_buf[2 * i] = (short)lrintf(s[first + i].real() / scale);
+		m_buf[2 * i + 1] = (short)lrintf(s[first + i].imag() / scale);
+	}
+	if((fwrite(&rec, sizeof(rec), 1, m_fp) != 1) ||
+	   (fwrite(m_buf, 2 * sizeof(short), n, m_fp) != n) || fflush(m_fp)) {
+		fprintf(stderr, "error: burst_archive: %s: %s\n", m_path,
+		   strerror(errno));
+		r = -1;
+	}
+	pthread_mutex_unlock(&m_mutex);
+
+	return r;
+}
+
+
+/*
+ * Reads the next record and its samples, which stay valid until the next
+ * call.  Returns 1 at the end of the archive and -1 if it is corrupt.
+ */
+int burst_archive::next(burst_record *rec, complex **s) {
+
+	unsigned int i;
+
+	if(fread(rec, sizeof(*rec), 1, m_fp) != 1)
+		return ferror(m_fp)? -1 : 1;
+	if(memcmp(rec->magic, MAGIC, sizeof(rec->magic)) ||
+	   (rec->start + rec->burst > rec->len)) {
+		fprintf(stderr, "error: burst_archive: %s: bad record\n",
+		   m_path);
+		return -1;
+	}
+
+	if(m_out_len < rec->len) {
+		delete[] m_buf;
+		delete[] m_out;
+		m_out_len = rec->len;
+		m_buf_len = 2 * rec->len;
+		m_buf = new short[m_buf_len];
+		m_out = new complex[m_out_len];
+	}
+	if(fread(m_buf, 2 * sizeof(short), rec->len, m_fp) != rec->len) {
+		fprintf(stderr, "error: burst_archive: %s: truncated\n", m_path);
+		return -1;
+	}
+	sc16_to_fc32(m_buf, m_out, rec->len);
+	for(i = 0; i < rec->len; i++)
+		m_out[i] *= rec->scale;
+	*s = m_out;
+
+	return 0;
+}
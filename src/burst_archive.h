@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * burst_archive
+ *
+ * Append-only file of the FCCH bursts behind the offsets we report, so
+ * they can be audited and measured again offline without keeping whole
+ * captures.  Each record is a fixed header followed by its samples as
+ * interleaved 16-bit I/Q, in host byte order, scaled so the largest
+ * component is full scale:
+ *
+ *	magic	"KALB"
+ *	len	samples in the record
+ *	chan	ARFCN and band indicator the carrier was measured on, -1
+ *	bi	and BI_NOT_DEFINED if it isn't a GSM channel
+ *	start	first of the samples the offset was measured from, after
+ *		the leading guard samples
+ *	burst	how many samples it was measured from
+ *	rate	sample rate
+ *	offset	frequency offset reported, Hz
+ *	pm	peak to mean ratio of the tone
+ *	scale	multiply the samples by this to restore their amplitude
+ *	freq	carrier frequency, Hz
+ *	when	device time of the first sample, or -1 if it wasn't known
+ *	wall	seconds since the epoch when it was measured
+ *
+ * Every record says how long it is, so the headers alone index the file
+ * and each run just appends.  A last record cut short by a crash is
+ * dropped before appending.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "usrp_complex.h"
+
+struct burst_record {
+	char		magic[4];
+	uint32_t	len;
+	int32_t		chan,
+			bi;
+	uint32_t	start,
+			burst;
+	float		rate,
+			offset,
+			pm,
+			scale;
+	double		freq,
+			when,
+			wall;
+};
+
+class burst_archive {
+public:
+	burst_archive(const char *path);
+	~burst_archive();
+
+	int open(bool append);
+	int add(const complex *s, unsigned int s_len, float start,
+	   unsigned int len, float rate, double freq, int chan, int bi,
+	   double when, float offset, float pm);
+	int next(burst_record *rec, complex **s);
+
+	// symbols kept either side of the burst
+	static const unsigned int	GUARD		= 16;
+
+private:
+	int recover();
+
+	char		*m_path;
+	FILE		*m_fp;
+	short		*m_buf;
+	unsigned int	m_buf_len;
+	complex		*m_out;
+	unsigned int	m_out_len;
+
+	// several devices may be measured at once
+	pthread_mutex_t	m_mutex;
+};
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "c0_cache.h"
+
+static const char C0_STATES[] = "?pfn";
+
+
+c0_cache::c0_cache(const char *path) {
+
+	m_path = strdup(path);
+	m_fp = 0;
+	m_entries = new c0_entry[BI_COUNT * ARFCN_MAX];
+	memset(m_entries, 0, BI_COUNT * ARFCN_MAX * sizeof(c0_entry));
+	memset(m_started, 0, sizeof(m_started));
+	memset(m_finished, 0, sizeof(m_finished));
+}
+
+
+c0_cache::~c0_cache() {
+
+	if(m_fp)
+		fclose(m_fp);
+	delete[] m_entries;
+	free(m_path);
+}
+
+
+c0_entry *c0_cache::find(int bi, int chan) {
+
+	if((bi <= BI_NOT_DEFINED) || (bi >= BI_COUNT) || (chan < 0) ||
+	   (chan >= ARFCN_MAX))
+		return 0;
+
+	return &m_entries[bi * ARFCN_MAX + chan];
+}
+
+
+/*
+ * Applies one line of the log.  Returns -1 if it doesn't parse.
+ */
+int c0_cache::parse(const char *line) {
+
+	char band[64], state;
+	int bi, chan;
+	long seen, started, finished;
+	float power, offset;
+	const char *s;
+	c0_entry *e;
+
+	if((line[0] == '#') || (line[0] == '\n'))
+		return 0;
+
+	if(sscanf(line, "chan %63s %d %f %f %c %ld", band, &chan, &power,
+	   &offset, &state, &seen) == 6) {
+		if((!(e = find(str_to_bi(band), chan))) ||
+		   (!(s = strchr(C0_STATES + 1, state))))
+			return -1;
+		e->state = s - C0_STATES;
+		e->power = power;
+		e->offset = offset;
+		e->seen = seen;
+		return 0;
+	}
+
+	if(sscanf(line, "sweep %63s %ld %ld", band, &started, &finished) == 3) {
+		bi = str_to_bi(band);
+		if((bi <= BI_NOT_DEFINED) || (bi >= BI_COUNT))
+			return -1;
+		m_started[bi] = started;
+		m_finished[bi] = finished;
+		return 0;
+	}
+
+	return -1;
+}
+
+
+/*
+ * Reads the log, if there is one, and rewrites it compacted.  A last line
+ * that is cut short or doesn't parse is what a crash in the middle of an
+ * append leaves behind, so it is dropped with a warning; a bad line
+ * anywhere else is an error.  Returns -1 on error.
+ */
+int c0_cache::load() {
+
+	char line[BUFSIZ], tmp[BUFSIZ];
+	int bi, chan, c, lineno = 0;
+	bool last;
+	FILE *fp;
+
+	if((fp = fopen(m_path, "r"))) {
+		while(fgets(line, sizeof(line), fp)) {
+			lineno++;
+			if(!(last = ((c = getc(fp)) == EOF)))
+				ungetc(c, fp);
+			if(last && (!strchr(line, '\n') || parse(line))) {
+				fprintf(stderr, "warning: c0_cache: %s:%d: "
+				   "incomplete last line ignored\n", m_path,
+				   lineno);
+				break;
+			}
+			if(!last && parse(line)) {
+				fprintf(stderr, "error: c0_cache: %s:%d: bad "
+				   "line\n", m_path, lineno);
+				fclose(fp);
+				return -1;
+			}
+		}
+		fclose(fp);
+	} else if(errno != ENOENT) {
+		fprintf(stderr, "error: c0_cache: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+
+	// compact
+	snprintf(tmp, sizeof(tmp), "%s.tmp", m_path);
+	if(!(fp = fopen(tmp, "w"))) {
+		fprintf(stderr, "error: c0_cache: %s: %s\n", tmp,
+		   strerror(errno));
+		return -1;
+	}
+	fprintf(fp, "# kalibrate scan cache\n");
+	for(bi = BI_NOT_DEFINED + 1; bi < BI_COUNT; bi++) {
+		if(m_started[bi])
+			write_sweep(fp, bi);
+		for(chan = 0; chan < ARFCN_MAX; chan++)
+			if(find(bi, chan)->state != C0_UNKNOWN)
+				write_chan(fp, bi, chan);
+	}
+	if(fclose(fp) || rename(tmp, m_path)) {
+		fprintf(stderr, "error: c0_cache: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+
+	return open_log();
+}
+
+
+int c0_cache::open_log() {
+
+	if(!(m_fp = fopen(m_path, "a"))) {
+		fprintf(stderr, "error: c0_cache: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int c0_cache::write_chan(FILE *fp, int bi, int chan) {
+
+	c0_entry *e = find(bi, chan);
+
+	fprintf(fp, "chan %s %d %.2f %.2f %c %ld\n", bi_to_str(bi), chan,
+	   e->power, e->offset, C0_STATES[e->state], (long)e->seen);
+
+	return fflush(fp)? -1 : 0;
+}
+
+
+int c0_cache::write_sweep(FILE *fp, int bi) {
+
+	fprintf(fp, "sweep %s %ld %ld\n", bi_to_str(bi), (long)m_started[bi],
+	   (long)m_finished[bi]);
+
+	return fflush(fp)? -1 : 0;
+}
+
+
+/*
+ * Records what we know about a channel now.
+ */
+int c0_cache::update(int bi, int chan, float power, float offset, int state) {
+
+	c0_entry *e;
+
+	if(!(e = find(bi, chan)))
+		return -1;
+	e->state = state;
+	e->power = power;
+	e->offset = offset;
+	e->seen = time(0);
+
+	return m_fp? write_chan(m_fp, bi, chan) : 0;
+}
+
+
+int c0_cache::sweep_start(int bi) {
+
+	if((bi <= BI_NOT_DEFINED) || (bi >= BI_COUNT))
+		return -1;
+	m_started[bi] = time(0);
+	m_finished[bi] = 0;
+
+	return m_fp? write_sweep(m_fp, bi) : 0;
+}
+
+
+int c0_cache::sweep_done(int bi) {
+
+	if((bi <= BI_NOT_DEFINED) || (bi >= BI_COUNT) || (!m_started[bi]))
+		return -1;
+	m_finished[bi] = time(0);
+
+	return m_fp? write_sweep(m_fp, bi) : 0;
+}
+
+
+/*
+ * Start of the last sweep of the band, 0 if there never was one.
+ */
+time_t c0_cache::sweep_started(int bi) {
+
+	return ((bi <= BI_NOT_DEFINED) || (bi >= BI_COUNT))? 0 : m_started[bi];
+}
+
+
+/*
+ * End of the last sweep of the band, 0 if it never finished.
+ */
+time_t c0_cache::sweep_finished(int bi) {
+
+	return ((bi <= BI_NOT_DEFINED) || (bi >= BI_COUNT))? 0 : m_finished[bi];
+}
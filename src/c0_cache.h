@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * c0_cache
+ *
+ * On-disk record of base station scans.  The file is a log of lines
+ *
+ *	chan <band> <arfcn> <power> <offset> <state> <seen>
+ *	sweep <band> <started> <finished>
+ *
+ * where state is p (power measured), f (FCCH found) or n (no FCCH), the
+ * times are in seconds since the epoch and finished is 0 while a sweep is
+ * still running.  Later lines override earlier ones, each update is
+ * appended and flushed as it happens so an interrupted scan loses nothing,
+ * and the log is compacted every time it is loaded.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+#include "arfcn_freq.h"
+
+enum {
+	C0_UNKNOWN,
+	C0_POWER,
+	C0_FOUND,
+	C0_NOTFOUND
+};
+
+struct c0_entry {
+	int	state;
+	float	power,
+		offset;
+	time_t	seen;
+};
+
+class c0_cache {
+public:
+	c0_cache(const char *path);
+	~c0_cache();
+
+	int load();
+	c0_entry *find(int bi, int chan);
+	int update(int bi, int chan, float power, float offset, int state);
+	int sweep_start(int bi);
+	int sweep_done(int bi);
+	time_t sweep_started(int bi);
+	time_t sweep_finished(int bi);
+
+	static const int	ARFCN_MAX	= 1024;
+
+private:
+	int parse(const char *line);
+	int open_log();
+	int write_chan(FILE *fp, int bi, int chan);
+	int write_sweep(FILE *fp, int bi);
+
+	char		*m_path;
+	FILE		*m_fp;
+	c0_entry	*m_entries;	// BI_COUNT * ARFCN_MAX
+	time_t		m_started[BI_COUNT],
+			m_finished[BI_COUNT];
+};
@@ -28,79 +28,728 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <vector>
+#include <deque>
 
 #include "usrp_source.h"
 #include "circular_buffer.h"
 #include "fcch_detector.h"
 #include "arfcn_freq.h"
+#include "statistics.h"
+#include "c0_cache.h"
+#include "c0_detect.h"
+#include "profile.h"
+#include "gain.h"
 #include "util.h"
+#include "rt.h"
 
 extern int g_verbosity;
 
 static const float ERROR_DETECT_OFFSET_MAX = 40e3;
+static const int NOTFOUND_MAX = 10;		// captures without an FCCH
+static const long WORKERS_MAX = 4;
+
+/*
+ * A channel to visit.  Channels from every requested band are first
+ * visited in order of frequency so the LO steps up; only captures
+ * repeated after no FCCH was found step back.
+ */
+struct c0_chan {
+	int	chan,
+		bi,
+		order,		// of its band in the bands asked for
+		state,
+		checked,	// looked at during this run
+		tries,		// captures searched for an FCCH
+		wanted,		// in the channel set
+		ref;		// sets the noise floor
+	double	freq,
+		power;
+	float	offset,
+		gain;		// gain the FCCH search started at
+	time_t	seen;
+};
 
-static double vectornorm2(const complex *v, const unsigned int len) {
 
-	unsigned int i;
-	double e = 0.0;
+/*
+ * By frequency, and a channel in two bands by the order they were asked
+ * for in, as qsort() isn't stable.
+ */
+static int c0_chan_cmp(const void *a, const void *b) {
 
-	for(i = 0; i < len; i++)
-		e += norm(v[i]);
+	const c0_chan *ca = (const c0_chan *)a, *cb = (const c0_chan *)b;
 
-	return e;
+	if(ca->freq != cb->freq)
+		return (ca->freq < cb->freq)? -1 : 1;
+	return ca->order - cb->order;
 }
 
 
-int c0_detect(usrp_source *u, int bi) {
+struct c0_pipe;
+
+/*
+ * One capture on its way through the pipeline.  The capture stage fills in
+ * b and what is to be done with it, a worker the results.
+ */
+struct c0_job {
+	c0_chan *	ch;
+	struct c0_radio *r;		// captured by
+	complex *	b;
+	unsigned int	len;
+	int		power,		// measure the power
+			fcch,		// look for an FCCH burst
+			found;
+	float		offset;
+	double		energy;
+};
+
+
+/*
+ * A device and its capture stage.  Each takes the next channel of the pass
+ * when it has a job free, and captures it again itself if no FCCH burst
+ * was found, so a channel's power and gain are those of one device.
+ */
+struct c0_radio {
+	c0_pipe *		p;
+	usrp_source *		u;
+	fcch_detector *		l;	// when there are no workers
+	double			tuned;
+	float			cur;	// gain the device is at
+	pthread_t		tid;
+	int			running;
 
-	static const double GSM_RATE = 1625000.0 / 6.0;
-	static const unsigned int NOTFOUND_MAX = 10;
+	std::vector<c0_job>	jobs;
+	std::deque<c0_job *>	done;	// by the workers
+	std::deque<c0_chan *>	again;
+};
 
-	int i, chan_count;
-	unsigned int overruns, b_len, frames_len, found_count, notfound_count, r;
-	float offset, spower[BUFSIZ];
-	double freq, sps, n, power[BUFSIZ], sum = 0, a;
-	complex *b;
-	circular_buffer *ub;
-	fcch_detector *l = new fcch_detector(u->sample_rate());
 
-	if(bi == BI_NOT_DEFINED) {
-		fprintf(stderr, "error: c0_detect: band not defined\n");
-		return -1;
+/*
+ * Every device has a capture stage, the first in the caller's thread and
+ * the rest in threads of their own, which keep the radios busy, handing
+ * each capture to the workers through todo while they tune to the next
+ * channel.  Finished jobs go back to the device they came from.  With no
+ * workers (when profiling, which only follows one thread) each capture
+ * stage does the work itself.
+ */
+struct c0_pipe {
+	std::vector<c0_radio>	radios;
+	c0_cache *		cache;
+	unsigned int		frames_len;
+	int			agc;
+	float			gain;	// of the sweep
+
+	std::vector<pthread_t>	workers;
+	pthread_mutex_t		mutex;	// everything below, the channels and
+	pthread_cond_t		cond;	// the cache
+	std::deque<c0_job *>	todo;
+	int			quit;
+
+	// the pass under way
+	std::vector<c0_chan *> *list;
+	unsigned int		next;
+	int			power,
+				fcch,
+				error;
+};
+
+
+/*
+ * Tunes to freq, unless we already are, and fills the buffer with
+ * frames_len fresh samples.
+ */
+static int c0_capture(usrp_source *u, double freq, double *tuned,
+   unsigned int frames_len) {
+
+	unsigned int overruns;
+
+	if(freq != *tuned) {
+		if(!u->tune(freq)) {
+			fprintf(stderr, "error: usrp_source::tune\n");
+			return -1;
+		}
+		*tuned = freq;
 	}
 
-	sps = u->sample_rate() / GSM_RATE;
-	frames_len = (unsigned int)ceil((12 * 8 * 156.25 + 156.25) * sps);
-	ub = u->get_buffer();
+	do {
+		u->flush();
+		if(u->fill(frames_len, &overruns)) {
+			fprintf(stderr, "error: usrp_source::fill\n");
+			return -1;
+		}
+	} while(overruns);
+
+	return 0;
+}
+
+
+static void c0_work(fcch_detector *l, c0_job *j) {
+
+	float offset;
+
+	if(j->power)
+		j->energy = vectornorm2(j->b, j->len);
+	if(j->fcch && l->scan(j->b, j->len, &offset, 0) &&
+	   (fabsf(offset - GSM_RATE / 4) < ERROR_DETECT_OFFSET_MAX)) {
+		j->found = 1;
+		j->offset = offset - GSM_RATE / 4;
+	}
+}
+
+
+static void *c0_worker(void *arg) {
+
+	c0_pipe *p = (c0_pipe *)arg;
+	fcch_detector *l;
+	c0_job *j;
+
+	l = new fcch_detector(p->radios[0].u->sample_rate());
+
+	pthread_mutex_lock(&p->mutex);
+	for(;;) {
+		while(p->todo.empty() && (!p->quit))
+			pthread_cond_wait(&p->cond, &p->mutex);
+		if(p->todo.empty())
+			break;
+		j = p->todo.front();
+		p->todo.pop_front();
+		pthread_mutex_unlock(&p->mutex);
+
+		c0_work(l, j);
+
+		pthread_mutex_lock(&p->mutex);
+		j->r->done.push_back(j);
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	delete l;
+
+	return 0;
+}
+
+
+/*
+ * Starts a worker per CPU, leaving one to each capture stage and its
+ * driver, up to WORKERS_MAX.  The workers don't take the real-time
+ * priority of the capture stages, which mustn't wait on them.
+ */
+static void c0_pipe_start(c0_pipe *p) {
+
+	unsigned int i, k;
+	pthread_attr_t attr;
+	pthread_t tid;
+	long n = 0;
+	int r;
+
+	pthread_mutex_init(&p->mutex, 0);
+	pthread_cond_init(&p->cond, 0);
+	p->quit = 0;
+
+	if(!g_profile) {
+		n = sysconf(_SC_NPROCESSORS_ONLN) - (long)p->radios.size();
+		n = (n < 1)? 1 : ((n > WORKERS_MAX)? WORKERS_MAX : n);
+	}
+	rt_worker(&attr);
+	for(i = 0; i < n; i++) {
+		if((r = pthread_create(&tid, &attr, c0_worker, p))) {
+			fprintf(stderr, "error: c0_detect: pthread_create: %s\n",
+			   strerror(r));
+			break;
+		}
+		p->workers.push_back(tid);
+	}
+	pthread_attr_destroy(&attr);
+
+	// enough captures in flight to keep every worker and radio busy
+	for(k = 0; k < p->radios.size(); k++) {
+		p->radios[k].jobs.resize(p->workers.size() + 2);
+		for(i = 0; i < p->radios[k].jobs.size(); i++) {
+			p->radios[k].jobs[i].r = &p->radios[k];
+			p->radios[k].jobs[i].b = new complex[p->frames_len];
+		}
+	}
 
-	// first, we calculate the power in each channel
 	if(g_verbosity > 2) {
-		fprintf(stderr, "calculate power in each channel:\n");
+		fprintf(stderr, "c0_detect: %u devices, %u workers\n",
+		   (unsigned int)p->radios.size(),
+		   (unsigned int)p->workers.size());
 	}
-	u->start();
-	u->flush();
-	for(i = first_chan(bi); i > 0; i = next_chan(i, bi)) {
-		freq = arfcn_to_freq(i, &bi);
-		if(!u->tune(freq)) {
-			fprintf(stderr, "error: usrp_source::tune\n");
+}
+
+
+/*
+ * Lets the workers finish what they were given and waits for them.
+ */
+static void c0_pipe_stop(c0_pipe *p) {
+
+	unsigned int i, k;
+
+	pthread_mutex_lock(&p->mutex);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+	for(i = 0; i < p->workers.size(); i++)
+		pthread_join(p->workers[i], 0);
+	p->workers.clear();
+
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->mutex);
+	for(k = 0; k < p->radios.size(); k++) {
+		for(i = 0; i < p->radios[k].jobs.size(); i++)
+			delete[] p->radios[k].jobs[i].b;
+		p->radios[k].jobs.clear();
+		p->radios[k].done.clear();
+		p->radios[k].again.clear();
+	}
+}
+
+
+/*
+ * Captures the channel into j.  Power is always measured at the gain of
+ * the sweep so every channel is measured alike.  With agc, a channel
+ * whose first capture clips or is far below full scale is searched at a
+ * gain ranged for it, which the next channel then starts from.
+ */
+static int c0_issue(c0_pipe *p, c0_radio *r, c0_chan *ch, c0_job *j) {
+
+	unsigned int b_len;
+	float g;
+	complex *b;
+
+	j->ch = ch;
+	j->len = p->frames_len;
+	j->power = p->power && (!ch->tries);
+	j->fcch = p->fcch;
+	j->found = 0;
+	if(p->fcch) {
+		if(ch->tries)
+			profile_count(PROF_RETRIES);
+		ch->tries++;
+	}
+
+	g = j->power? p->gain : ((ch->tries > 1)? ch->gain : r->cur);
+	if(g != r->cur) {
+		if(!r->u->set_gain(g))
+			return -1;
+		r->cur = g;
+	}
+
+	if(c0_capture(r->u, ch->freq, &r->tuned, p->frames_len))
+		return -1;
+	b = (complex *)r->u->get_buffer()->peek(&b_len);
+
+	if(p->fcch && p->agc && (ch->tries == 1) &&
+	   (!gain_ok(b, p->frames_len))) {
+		if(j->power) {
+			ch->power = sqrt(vectornorm2(b, p->frames_len));
+			j->power = 0;
+		}
+		if(gain_range(r->u, &r->cur) ||
+		   c0_capture(r->u, ch->freq, &r->tuned, p->frames_len))
 			return -1;
+		b = (complex *)r->u->get_buffer()->peek(&b_len);
+		if(g_verbosity > 1) {
+			fprintf(stderr, "\tchan %d (%.1fMHz):\tgain %.1f%%\n",
+			   ch->chan, ch->freq / 1e6, 100.0 * r->cur);
 		}
+	}
+	if(p->fcch && (ch->tries == 1))
+		ch->gain = r->cur;
 
-		do {
-			u->flush();
-			if(u->fill(frames_len, &overruns)) {
-				fprintf(stderr, "error: usrp_source::fill\n");
-				return -1;
-			}
-		} while(overruns);
+	memcpy(j->b, b, p->frames_len * sizeof(complex));
+
+	return 0;
+}
+
+
+static void c0_record(c0_cache *cache, c0_chan *ch) {
+
+	if(cache)
+		cache->update(ch->bi, ch->chan, ch->power, ch->offset, ch->state);
+}
+
+
+/*
+ * Takes in what a worker made of j, with the pipe locked.  A channel where
+ * no FCCH burst was found is captured once more by the same device, up to
+ * NOTFOUND_MAX times.  When both the power and the FCCH are asked for the
+ * channel is a carrier found before being verified.
+ */
+static void c0_finish(c0_pipe *p, c0_job *j) {
+
+	c0_chan *ch = j->ch;
 
-		b = (complex *)ub->peek(&b_len);
-		n = sqrt(vectornorm2(b, frames_len));
-		power[i] = n;
+	if(j->power)
+		ch->power = sqrt(j->energy);
+	if(!j->fcch) {
+		ch->state = C0_POWER;
+		ch->seen = time(0);
+		c0_record(p->cache, ch);
 		if(g_verbosity > 2) {
 			fprintf(stderr, "\tchan %d (%.1fMHz):\tpower: %lf\n",
-			   i, freq / 1e6, n);
+			   ch->chan, ch->freq / 1e6, ch->power);
 		}
+		return;
+	}
+
+	if(j->found) {
+		ch->state = C0_FOUND;
+		ch->offset = j->offset;
+	} else if(ch->tries < NOTFOUND_MAX) {
+		j->r->again.push_back(ch);
+		return;
+	} else
+		ch->state = C0_NOTFOUND;
+	ch->checked = 1;
+	c0_record(p->cache, ch);
+
+	if(p->power && (g_verbosity > 1)) {
+		fprintf(stderr, "\tchan %d (%.1fMHz):\t%s\n", ch->chan,
+		   ch->freq / 1e6, (ch->state == C0_FOUND)? "verified" :
+		   "gone");
+	}
+}
+
+
+/*
+ * The capture stage of r for one pass.  A channel to capture again is
+ * taken before the next new one, and the stage stops taking channels once
+ * any device has failed.
+ */
+static void c0_radio_pass(c0_pipe *p, c0_radio *r) {
+
+	std::vector<c0_job *> idle;
+	unsigned int i, busy = 0;
+	c0_chan *ch;
+	c0_job *j;
+	int e;
+
+	for(i = 0; i < r->jobs.size(); i++)
+		idle.push_back(&r->jobs[i]);
+
+	pthread_mutex_lock(&p->mutex);
+	for(;;) {
+		while(busy && r->done.empty() && (idle.empty() ||
+		   p->error || (r->again.empty() &&
+		   (p->next >= p->list->size()))))
+			pthread_cond_wait(&p->cond, &p->mutex);
+
+		while(!r->done.empty()) {
+			j = r->done.front();
+			r->done.pop_front();
+			busy--;
+			idle.push_back(j);
+			c0_finish(p, j);
+		}
+
+		if(p->error) {
+			if(busy)
+				continue;
+			break;
+		}
+		if(!r->again.empty()) {
+			ch = r->again.front();
+			r->again.pop_front();
+		} else if(p->next < p->list->size())
+			ch = (*p->list)[p->next++];
+		else if(busy)
+			continue;
+		else
+			break;
+
+		j = idle.back();
+		idle.pop_back();
+		pthread_mutex_unlock(&p->mutex);
+
+		e = c0_issue(p, r, ch, j);
+		if((!e) && p->workers.empty())
+			c0_work(r->l, j);
+
+		pthread_mutex_lock(&p->mutex);
+		if(e || p->workers.empty()) {
+			idle.push_back(j);
+			if(e)
+				p->error = 1;
+			else
+				c0_finish(p, j);
+			pthread_cond_broadcast(&p->cond);
+			continue;
+		}
+		p->todo.push_back(j);
+		pthread_cond_broadcast(&p->cond);
+		busy++;
+	}
+	pthread_mutex_unlock(&p->mutex);
+}
+
+
+static void *c0_radio_main(void *arg) {
+
+	c0_radio *r = (c0_radio *)arg;
+
+	c0_radio_pass(r->p, r);
+
+	return 0;
+}
+
+
+/*
+ * Runs the channels in list through the pipeline, measuring the power of
+ * each if power is set and looking for an FCCH burst if fcch is.  The
+ * devices share out the channels between them as they become free.
+ */
+static int c0_pass(c0_pipe *p, std::vector<c0_chan *> &list, int power,
+   int fcch) {
+
+	unsigned int k;
+	int r;
+
+	p->list = &list;
+	p->next = 0;
+	p->power = power;
+	p->fcch = fcch;
+	p->error = 0;
+
+	for(k = 1; k < p->radios.size(); k++) {
+		p->radios[k].running = 0;
+		if((r = pthread_create(&p->radios[k].tid, 0, c0_radio_main,
+		   &p->radios[k]))) {
+			fprintf(stderr, "error: c0_detect: pthread_create: %s\n",
+			   strerror(r));
+			continue;
+		}
+		p->radios[k].running = 1;
+	}
+	c0_radio_pass(p, &p->radios[0]);
+	for(k = 1; k < p->radios.size(); k++) {
+		if(p->radios[k].running)
+			pthread_join(p->radios[k].tid, 0);
+	}
+
+	return p->error? -1 : 0;
+}
+
+
+/*
+ * Puts every device back as the scan found it.
+ */
+static void c0_radios_stop(c0_pipe *p) {
+
+	unsigned int k;
+	c0_radio *r;
+
+	for(k = 0; k < p->radios.size(); k++) {
+		r = &p->radios[k];
+		r->u->stop();
+		if(r->cur != p->gain)
+			r->u->set_gain(p->gain);
+		if(k)
+			delete r->l;
+	}
+}
+
+
+/*
+ * Gives up on a scan part way through.
+ */
+static int c0_abort(c0_pipe *p, c0_chan *chans) {
+
+	c0_pipe_stop(p);
+	c0_radios_stop(p);
+	delete[] chans;
+
+	return -1;
+}
+
+
+/*
+ * Scans the bi_count bands in bi in a single pass with the u_count devices
+ * in u.  Up to found_max of the carriers found are returned in found, in
+ * order of frequency.  Returns how many there were, or -1 on error.
+ *
+ * With a cache, carriers found before are verified first and a band is
+ * only swept again if asked to, if it never was, or if the last sweep was
+ * interrupted, in which case the channels it already covered are skipped.
+ *
+ * Every channel's power is measured at gain.  With agc, the gain is ranged
+ * again for the FCCH search on any channel it doesn't suit.
+ *
+ * If only is given, just the ARFCNs marked in it are visited rather than
+ * the whole of every band.  The noise floor of a band comes from its
+ * channels marked in ref if there are any.  Otherwise it comes from every
+ * channel of the band, or there is none with a channel set and every
+ * channel in it is searched.  A channel set isn't a sweep of the band, so
+ * the cache only records the channels.
+ *
+ * Each capture is searched by a worker thread while its device is already
+ * tuning to the next channel, so l is only used when there are no workers.
+ * With several devices each channel is measured by whichever is free, and
+ * its offset is relative to that device's clock.
+ */
+int c0_scan(usrp_source **u, int u_count, fcch_detector *l, int *bi,
+   int bi_count, c0_cache *cache, int sweep, c0_result *found,
+   int found_max, int agc, float gain, const char *only, const char *ref) {
+
+	int i, j, b, k, r, chan_count, found_count, need[BI_COUNT];
+	unsigned int frames_len;
+	double freq, sps, threshold[BI_COUNT];
+	time_t since[BI_COUNT];
+	std::vector<c0_chan *> list;
+	c0_chan *chans, *ch;
+	c0_entry *e;
+	c0_pipe p;
+
+	for(j = 0; j < bi_count; j++) {
+		if((bi[j] <= BI_NOT_DEFINED) || (bi[j] >= BI_COUNT)) {
+			fprintf(stderr, "error: c0_detect: band not defined\n");
+			return -1;
+		}
+	}
+
+	// one frames_len and one detector for all
+	for(k = 1; k < u_count; k++) {
+		if(u[k]->sample_rate() != u[0]->sample_rate()) {
+			fprintf(stderr, "error: c0_detect: devices differ in "
+			   "sample rate\n");
+			return -1;
+		}
+	}
+
+	// every channel in every band, or in the set, in order of frequency
+	chan_count = 0;
+	for(j = 0; j < bi_count; j++)
+		for(i = first_chan(bi[j]); i >= 0; i = next_chan(i, bi[j]))
+			chan_count++;
+	chans = new c0_chan[chan_count];
+	chan_count = 0;
+	for(j = 0; j < bi_count; j++) {
+		for(i = first_chan(bi[j]); i >= 0; i = next_chan(i, bi[j])) {
+			if(only && (!only[i]) && ((!ref) || (!ref[i])))
+				continue;
+			b = bi[j];
+			if((freq = arfcn_to_freq(i, &b)) < 0.0)
+				continue;
+			ch = &chans[chan_count++];
+			memset(ch, 0, sizeof(*ch));
+			ch->chan = i;
+			ch->bi = bi[j];
+			ch->order = j;
+			ch->freq = freq;
+			ch->state = C0_UNKNOWN;
+			ch->wanted = (!only) || only[i];
+			ch->ref = ref && ref[i];
+			if(cache && (e = cache->find(ch->bi, ch->chan))) {
+				ch->state = e->state;
+				ch->power = e->power;
+				ch->offset = e->offset;
+				ch->seen = e->seen;
+			}
+		}
+	}
+	qsort(chans, chan_count, sizeof(*chans), c0_chan_cmp);
+
+	/*
+	 * Overlapping bands (GSM-900 and E-GSM-900) are only visited once, as
+	 * the first band asked for, so the carrier is always reported and
+	 * cached under the same one.
+	 */
+	for(i = 1, k = 1; i < chan_count; i++) {
+		if(chans[i].freq != chans[k - 1].freq)
+			chans[k++] = chans[i];
+	}
+	chan_count = (chan_count > 0)? k : 0;
+
+	for(k = 0; only && (k < chan_count) && (!chans[k].wanted); k++);
+	if(only && (k == chan_count)) {
+		fprintf(stderr, "error: c0_detect: no channel of the set is in "
+		   "the bands\n");
+		delete[] chans;
+		return -1;
+	}
+
+	/*
+	 * Which bands need sweeping (1), or resuming (2), and from when
+	 * results count as part of the sweep.
+	 */
+	for(j = 0; j < bi_count; j++) {
+		b = bi[j];
+		need[b] = 1;
+		since[b] = 0;
+		if((!cache) || only)
+			continue;
+		if(cache->sweep_started(b) && (!cache->sweep_finished(b))) {
+			need[b] = 2;
+			since[b] = cache->sweep_started(b);
+			if(g_verbosity > 0) {
+				fprintf(stderr, "resuming %s sweep\n",
+				   bi_to_str(b));
+			}
+		} else if((!sweep) && cache->sweep_finished(b))
+			need[b] = 0;
+	}
+
+	sps = u[0]->sample_rate() / GSM_RATE;
+	frames_len = (unsigned int)ceil((12 * 8 * 156.25 + 156.25) * sps);
+
+	p.cache = cache;
+	p.frames_len = frames_len;
+	p.agc = agc;
+	p.gain = gain;
+	p.radios.resize(u_count);
+	for(k = 0; k < u_count; k++) {
+		p.radios[k].p = &p;
+		p.radios[k].u = u[k];
+		p.radios[k].l = k? new fcch_detector(u[k]->sample_rate()) : l;
+		p.radios[k].tuned = -1.0;
+		p.radios[k].cur = gain;
+		u[k]->start();
+		u[k]->flush();
+	}
+	c0_pipe_start(&p);
+
+	// check the carriers we already know about
+	for(k = 0; cache && (k < chan_count); k++) {
+		ch = &chans[k];
+		if((!ch->wanted) || (ch->state != C0_FOUND) || (since[ch->bi] &&
+		   (ch->seen >= since[ch->bi])))
+			continue;
+		list.push_back(ch);
+	}
+	if(c0_pass(&p, list, 1, 1))
+		return c0_abort(&p, chans);
+
+	for(j = 0; cache && (j < bi_count); j++) {
+		if(only)
+			since[bi[j]] = time(0);
+		else if(need[bi[j]] == 1) {
+			cache->sweep_start(bi[j]);
+			since[bi[j]] = cache->sweep_started(bi[j]);
+		}
+	}
+
+	// first, we calculate the power in each channel
+	if(g_verbosity > 2) {
+		fprintf(stderr, "calculate power in each channel:\n");
+	}
+	{
+		profile_timer pt(PROF_C0_POWER);
+
+		list.clear();
+		for(k = 0; k < chan_count; k++) {
+			ch = &chans[k];
+			if((!need[ch->bi]) || ch->checked || (since[ch->bi] &&
+			   (ch->state != C0_UNKNOWN) &&
+			   (ch->seen >= since[ch->bi])))
+				continue;
+			list.push_back(ch);
+		}
+		if(c0_pass(&p, list, 1, 0))
+			return c0_abort(&p, chans);
 	}
 
 	/*
@@ -108,65 +757,125 @@ int c0_detect(usrp_source *u, int bi) {
 	 * power, and hence a possibility of being channel 0 on a BTS.
 	 * However, some channels in the band can be extremely noisy.  (E.g.,
 	 * CDMA traffic in GSM-850.)  Hence we won't consider the noisiest
-	 * channels when we construct the average.
+	 * channels when we construct the average.  Each band gets its own
+	 * threshold as the noise floor differs between them, taken from its
+	 * reference channels if it has any.  A channel set on its own may well
+	 * be all carriers, so without references every channel in it is
+	 * searched.
+	 *
+	 * The powers of a band, whether measured now or kept in the cache by
+	 * earlier scans, are streamed through a P-square estimate of their 60th
+	 * percentile and those at or below it are averaged, so there is no
+	 * limit to how many go into the floor.
 	 */
-	chan_count = 0;
-	for(i = first_chan(bi); i > 0; i = next_chan(i, bi)) {
-		spower[chan_count++] = power[i];
-	}
-	sort(spower, chan_count);
+	for(j = 0; j < bi_count; j++) {
+		if(!need[bi[j]])
+			continue;
+		for(k = 0, r = 0; k < chan_count; k++)
+			r |= (chans[k].bi == bi[j]) && chans[k].ref;
 
-	// average the lowest %60
-	a = avg(spower, chan_count - 4 * chan_count / 10, 0);
+		// average the lowest %60
+		p2_quantile q(0.6);
+		welford w;
+		for(k = 0; (k < chan_count) && ((!only) || r); k++) {
+			if((chans[k].bi == bi[j]) && ((!r) || chans[k].ref))
+				q.add(chans[k].power);
+		}
+		for(k = 0; (k < chan_count) && q.count(); k++) {
+			if((chans[k].bi == bi[j]) && ((!r) || chans[k].ref) &&
+			   (chans[k].power <= q.value()))
+				w.add(chans[k].power);
+		}
+		threshold[bi[j]] = w.mean();
 
-	if(g_verbosity > 0) {
-		fprintf(stderr, "channel detect threshold: %lf\n", a);
+		if(g_verbosity > 0) {
+			fprintf(stderr, "%s channel detect threshold: %lf\n",
+			   bi_to_str(bi[j]), threshold[bi[j]]);
+		}
 	}
 
 	// then we look for fcch bursts
-	printf("%s:\n", bi_to_str(bi));
-	found_count = 0;
-	notfound_count = 0;
-	sum = 0;
-	i = first_chan(bi);
-	do {
-		if(power[i] <= a) {
-			i = next_chan(i, bi);
-			continue;
+	{
+		profile_timer pt(PROF_C0_FCCH);
+
+		list.clear();
+		for(k = 0; k < chan_count; k++) {
+			ch = &chans[k];
+			if((!need[ch->bi]) || (!ch->wanted) || ch->checked ||
+			   (ch->power <= threshold[ch->bi]))
+				continue;
+			if(((ch->state == C0_FOUND) ||
+			   (ch->state == C0_NOTFOUND)) &&
+			   (ch->seen >= since[ch->bi]))
+				continue;
+			list.push_back(ch);
 		}
+		if(c0_pass(&p, list, 0, 1))
+			return c0_abort(&p, chans);
+	}
 
-		freq = arfcn_to_freq(i, &bi);
-		if(!u->tune(freq)) {
-			fprintf(stderr, "error: usrp_source::tune\n");
-			return -1;
+	for(j = 0; cache && (!only) && (j < bi_count); j++) {
+		if(need[bi[j]])
+			cache->sweep_done(bi[j]);
+	}
+
+	c0_pipe_stop(&p);
+	c0_radios_stop(&p);
+
+	for(k = 0, found_count = 0; k < chan_count; k++) {
+		ch = &chans[k];
+		if((!ch->wanted) || (ch->state != C0_FOUND))
+			continue;
+		if(found_count < found_max) {
+			found[found_count].chan = ch->chan;
+			found[found_count].bi = ch->bi;
+			found[found_count].freq = ch->freq;
+			found[found_count].power = ch->power;
+			found[found_count].offset = ch->offset;
 		}
+		found_count++;
+	}
 
-		do {
-			u->flush();
-			if(u->fill(frames_len, &overruns)) {
-				fprintf(stderr, "error: usrp_source::fill\n");
-				return -1;
-			}
-		} while(overruns);
-
-		b = (complex *)ub->peek(&b_len);
-		r = l->scan(b, b_len, &offset, 0);
-		if(r && (fabsf(offset - GSM_RATE / 4) < ERROR_DETECT_OFFSET_MAX)) {
-			// found
-			printf("\tchan: %d (%.1fMHz ", i, freq / 1e6);
-			display_freq(offset - GSM_RATE / 4);
-			printf(")\tpower: %6.2lf\n", power[i]);
-			notfound_count = 0;
-			i = next_chan(i, bi);
-		} else {
-			// not found
-			notfound_count += 1;
-			if(notfound_count >= NOTFOUND_MAX) {
-				notfound_count = 0;
-				i = next_chan(i, bi);
-			}
+	delete[] chans;
+
+	return found_count;
+}
+
+
+int c0_detect(usrp_source **u, int u_count, int *bi, int bi_count,
+   c0_cache *cache, int sweep, int agc, float gain, const char *only,
+   const char *ref) {
+
+	static const int FOUND_MAX = 1024;
+
+	int i, j, n;
+	c0_result *found;
+	fcch_detector *l;
+
+	found = new c0_result[FOUND_MAX];
+	l = new fcch_detector(u[0]->sample_rate());
+	n = c0_scan(u, u_count, l, bi, bi_count, cache, sweep, found,
+	   FOUND_MAX, agc, gain, only, ref);
+	delete l;
+	if(n < 0) {
+		delete[] found;
+		return -1;
+	}
+	if(n > FOUND_MAX)
+		n = FOUND_MAX;
+
+	for(j = 0; j < bi_count; j++) {
+		printf("%s:\n", bi_to_str(bi[j]));
+		for(i = 0; i < n; i++) {
+			if(found[i].bi != bi[j])
+				continue;
+			printf("\tchan: %d (%.1fMHz ", found[i].chan,
+			   found[i].freq / 1e6);
+			display_freq(found[i].offset);
+			printf(")\tpower: %6.2lf\n", found[i].power);
 		}
-	} while(i > 0);
+	}
+	delete[] found;
 
 	return 0;
 }
@@ -25,4 +25,21 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-int c0_detect(usrp_source *u, int bi);
+class c0_cache;
+class fcch_detector;
+
+struct c0_result {
+	int	chan,
+		bi;
+	double	freq,
+		power;
+	float	offset;
+};
+
+int c0_scan(usrp_source **u, int u_count, fcch_detector *l, int *bi,
+   int bi_count, c0_cache *cache, int sweep, c0_result *found,
+   int found_max, int agc = 0, float gain = 0.45, const char *only = 0,
+   const char *ref = 0);
+int c0_detect(usrp_source **u, int u_count, int *bi, int bi_count,
+   c0_cache *cache = 0, int sweep = 0, int agc = 0, float gain = 0.45,
+   const char *only = 0, const char *ref = 0);
@@ -46,6 +46,7 @@
 #endif /* !D_HOST_OSX */
 
 #include "circular_buffer.h"
+#include "rt.h"
 
 
 #ifndef D_HOST_OSX
@@ -168,6 +169,8 @@ circular_buffer::circular_buffer(const unsigned int buf_len,
 
 	m_overwrite = overwrite;
 
+	rt_memory(m_buf, 2 * m_buf_size);
+
 	pthread_mutex_init(&m_mutex, 0);
 }
 
@@ -289,6 +292,8 @@ circular_buffer::circular_buffer(const unsigned int buf_len,
 
 	m_overwrite = overwrite;
 
+	rt_memory(m_buf, 2 * m_buf_size);
+
 	pthread_mutex_init(&m_mutex, 0);
 }
 
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <stdexcept>
+
+#include "drift_stats.h"
+
+
+drift_stats::drift_stats(const double carrier, const unsigned int window,
+   const float trim) {
+
+	unsigned int i, len;
+
+	if(!window)
+		throw std::runtime_error("drift_stats: window is 0");
+
+	m_carrier = carrier;
+	m_window = window;
+	m_trim = (unsigned int)(trim * window);
+	if(2 * m_trim >= m_window)
+		m_trim = 0;
+	m_count = 0;
+	m_head = 0;
+	m_since = 0;
+	m_ring = new float[m_window];
+	m_sum = m_sum2 = 0.0;
+	m_t_first = m_t_last = 0.0;
+
+	for(i = 0, len = 1; i < ADEV_LEVELS; i++, len *= 10) {
+		m_block_len[i] = len;
+		m_block_n[i] = 0;
+		m_block_sum[i] = 0.0;
+		m_block_prev[i] = 0.0;
+		m_adev_sum[i] = 0.0;
+		m_blocks[i] = 0;
+	}
+}
+
+
+drift_stats::~drift_stats() {
+
+	delete[] m_ring;
+}
+
+
+/*
+ * Takes one copy of offset out of whichever part of the window holds it.
+ * Equal values may straddle a boundary, but any copy will do.
+ */
+void drift_stats::remove(const float offset) {
+
+	if(m_lo.size() && (offset <= *m_lo.rbegin()))
+		m_lo.erase(m_lo.find(offset));
+	else if(m_hi.size() && (offset >= *m_hi.begin()))
+		m_hi.erase(m_hi.find(offset));
+	else {
+		m_mid.erase(m_mid.find(offset));
+		m_sum -= offset;
+		m_sum2 -= (double)offset * offset;
+	}
+}
+
+
+/*
+ * Moves offsets across the boundaries until each tail holds as many as are
+ * trimmed, proportionally until the window has filled.  At most a couple
+ * move per add.
+ */
+void drift_stats::balance() {
+
+	unsigned int t;
+	float v;
+
+	t = (unsigned int)((double)m_trim * window_count() / m_window);
+
+	while(m_lo.size() > t) {
+		v = *m_lo.rbegin();
+		m_lo.erase(--m_lo.end());
+		m_mid.insert(v);
+		m_sum += v;
+		m_sum2 += (double)v * v;
+	}
+	while(m_hi.size() > t) {
+		v = *m_hi.begin();
+		m_hi.erase(m_hi.begin());
+		m_mid.insert(v);
+		m_sum += v;
+		m_sum2 += (double)v * v;
+	}
+	while(m_lo.size() < t) {
+		v = *m_mid.begin();
+		m_mid.erase(m_mid.begin());
+		m_lo.insert(v);
+		m_sum -= v;
+		m_sum2 -= (double)v * v;
+	}
+	while(m_hi.size() < t) {
+		v = *m_mid.rbegin();
+		m_mid.erase(--m_mid.end());
+		m_hi.insert(v);
+		m_sum -= v;
+		m_sum2 -= (double)v * v;
+	}
+}
+
+
+void drift_stats::add(const float offset, const double t) {
+
+	unsigned int w;
+	double y, b;
+	std::multiset<float>::iterator i;
+
+	// drop the oldest offset and put the new one on its side of the tails
+	if(window_count() == m_window)
+		remove(m_ring[m_head]);
+	if(m_lo.size() && (offset < *m_lo.rbegin()))
+		m_lo.insert(offset);
+	else if(m_hi.size() && (offset > *m_hi.begin()))
+		m_hi.insert(offset);
+	else {
+		m_mid.insert(offset);
+		m_sum += offset;
+		m_sum2 += (double)offset * offset;
+	}
+
+	m_ring[m_head] = offset;
+	m_head = (m_head + 1) % m_window;
+
+	if(!m_count)
+		m_t_first = t;
+	m_t_last = t;
+	m_count += 1;
+
+	balance();
+
+	// recompute the sums once a window so rounding can't build up over days
+	if(++m_since >= m_window) {
+		m_sum = m_sum2 = 0.0;
+		for(i = m_mid.begin(); i != m_mid.end(); i++) {
+			m_sum += *i;
+			m_sum2 += (double)*i * *i;
+		}
+		m_since = 0;
+	}
+
+	// fractional frequency
+	y = offset / m_carrier;
+	for(w = 0; w < ADEV_LEVELS; w++) {
+		m_block_sum[w] += y;
+		if(++m_block_n[w] < m_block_len[w])
+			continue;
+		b = m_block_sum[w] / m_block_len[w];
+		if(m_blocks[w])
+			m_adev_sum[w] += (b - m_block_prev[w]) * (b - m_block_prev[w]);
+		m_block_prev[w] = b;
+		m_blocks[w] += 1;
+		m_block_n[w] = 0;
+		m_block_sum[w] = 0.0;
+	}
+}
+
+
+unsigned int drift_stats::count() {
+
+	return m_count;
+}
+
+
+unsigned int drift_stats::window_count() {
+
+	return (m_count < m_window)? m_count : m_window;
+}
+
+
+double drift_stats::trimmed_mean(float *stddev) {
+
+	unsigned int n;
+	double mean, var;
+
+	if(!(n = m_mid.size())) {
+		if(stddev)
+			*stddev = 0.0;
+		return 0.0;
+	}
+
+	// population variance, as welford gives
+	mean = m_sum / n;
+	if(stddev) {
+		var = m_sum2 / n - mean * mean;
+		*stddev = (var > 0.0)? sqrt(var) : 0.0;
+	}
+
+	return mean;
+}
+
+
+/*
+ * Returns the Allan deviation for the given level, or a negative value if
+ * not enough blocks have been seen.  tau is estimated from the mean interval
+ * between measurements.
+ */
+double drift_stats::adev(const unsigned int level, double *tau) {
+
+	if(level >= ADEV_LEVELS)
+		return -1.0;
+
+	if(tau) {
+		if(m_count > 1)
+			*tau = m_block_len[level] * (m_t_last - m_t_first) / (m_count - 1);
+		else
+			*tau = 0.0;
+	}
+
+	if(m_blocks[level] < 2)
+		return -1.0;
+
+	return sqrt(m_adev_sum[level] / (2.0 * (m_blocks[level] - 1)));
+}
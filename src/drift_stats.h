@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * drift_stats
+ *
+ * Rolling statistics for long-running offset measurement.  A fixed window of
+ * the most recent offsets is kept for the trimmed mean and standard
+ * deviation, and a set of block averages is kept for the Allan deviation.
+ *
+ * The window is split by value into the trimmed low and high tails and the
+ * middle, with running sums over the middle, so adding an offset costs
+ * O(log window) and the trimmed mean and stddev are O(1).  Memory is bounded
+ * by the window, however long we have been running.
+ */
+
+#pragma once
+
+#include <set>
+
+class drift_stats {
+public:
+	drift_stats(const double carrier, const unsigned int window = 100, const float trim = 0.1);
+	~drift_stats();
+
+	void add(const float offset, const double t);
+	unsigned int count();
+	unsigned int window_count();
+	double trimmed_mean(float *stddev);
+	double adev(const unsigned int level, double *tau);
+
+	static const unsigned int ADEV_LEVELS = 4;
+
+private:
+	void remove(const float offset);
+	void balance();
+
+	double		m_carrier;
+	unsigned int	m_window,
+			m_trim,
+			m_count,
+			m_head,
+			m_since;	// adds since the sums were recomputed
+	float		*m_ring;
+
+	// the window by value: lowest m_lo.size(), the rest, highest m_hi.size()
+	std::multiset<float>	m_lo,
+				m_mid,
+				m_hi;
+	double		m_sum,		// over m_mid
+			m_sum2;
+
+	double		m_t_first,
+			m_t_last;
+
+	/*
+	 * Allan deviation at tau = 10^level * tau0 using non-overlapping block
+	 * averages of the fractional frequency.
+	 */
+	unsigned int	m_block_n[ADEV_LEVELS],
+			m_block_len[ADEV_LEVELS];
+	double		m_block_sum[ADEV_LEVELS],
+			m_block_prev[ADEV_LEVELS],
+			m_adev_sum[ADEV_LEVELS];
+	unsigned long	m_blocks[ADEV_LEVELS];
+};
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdexcept>
+
+#include "fcch_combiner.h"
+#include "util.h"
+
+static const double	FRAME_LEN	= 1250.0;	// symbols
+static const double	WINDOW_LEN	= 112.0;	// symbols, clear of the burst edges
+static const double	SCHEDULE_TOL	= 20.0;		// symbols
+static const double	GOLDEN		= 0.6180339887498949;
+
+
+fcch_combiner::fcch_combiner(const float sample_rate,
+   const unsigned int max_bursts) {
+
+	if(max_bursts < 2)
+		throw std::runtime_error("fcch_combiner: fewer than 2 bursts");
+
+	m_sample_rate = sample_rate;
+	m_sps = sample_rate / GSM_RATE;
+	m_max = max_bursts;
+	m_len = (unsigned int)(WINDOW_LEN * m_sps);
+	m_t = new double[m_max];
+	m_slope = new double[m_max];
+	m_w = new std::complex<double>[m_max];
+	m_r = new std::complex<double>[m_len];
+	reset();
+}
+
+
+fcch_combiner::~fcch_combiner() {
+
+	delete[] m_t;
+	delete[] m_slope;
+	delete[] m_w;
+	delete[] m_r;
+}
+
+
+void fcch_combiner::reset() {
+
+	m_count = 0;
+	m_ref = 0.0;
+	m_first = 0.0;
+}
+
+
+unsigned int fcch_combiner::count() {
+
+	return m_count;
+}
+
+
+/*
+ * Adds the burst of the capture s that is centered near sample center and
+ * measured offset Hz on its own.  The first burst places the window.  A
+ * later one is refused with -1 unless it is within SCHEDULE_TOL symbols of
+ * a whole number of frames after the first.  Also -1 if the window doesn't
+ * fit in s or max_bursts have been added.
+ */
+int fcch_combiner::add(const complex *s, const unsigned int s_len,
+   const double center, const float offset) {
+
+	unsigned int n;
+	double start, frames, w, ph, a, x, y, sy = 0.0, sxy = 0.0, sx, sxx;
+	std::complex<double> z(0.0, 0.0);
+
+	if(m_count >= m_max)
+		return -1;
+
+	start = round(center - m_len / 2.0);
+	if(!m_count) {
+		m_ref = offset;
+		m_first = start;
+	} else {
+		frames = round((start - m_first) / (FRAME_LEN * m_sps));
+		if((frames < 1.0) || (fabs(start - m_first - frames * FRAME_LEN *
+		   m_sps) > SCHEDULE_TOL * m_sps))
+			return -1;
+		start = m_first + round(frames * FRAME_LEN * m_sps);
+	}
+	if((start < 0.0) || (start + m_len > s_len))
+		return -1;
+
+	// mix the tone down to the reference, keeping time from the first burst
+	w = 2.0 * M_PI * (GSM_RATE / 4.0 + m_ref) / m_sample_rate;
+	for(n = 0; n < m_len; n++) {
+		ph = fmod(w * (start - m_first + n), 2.0 * M_PI);
+		m_r[n] = std::complex<double>(s[(unsigned int)start + n].real(),
+		   s[(unsigned int)start + n].imag()) *
+		   std::complex<double>(cos(ph), -sin(ph));
+		z += m_r[n];
+	}
+	if((a = abs(z)) <= 0.0)
+		return -1;
+
+	// slope of the phase across the window, which never wraps
+	for(n = 0; n < m_len; n++) {
+		x = n;
+		y = arg(m_r[n] * conj(z));
+		sy += y;
+		sxy += x * y;
+	}
+	sx = m_len * (m_len - 1) / 2.0;
+	sxx = m_len * (m_len - 1) * (2.0 * m_len - 1) / 6.0;
+	m_slope[m_count] = (m_len * sxy - sx * sy) / (m_len * sxx - sx * sx) *
+	   m_sample_rate / (2.0 * M_PI);
+
+	m_w[m_count] = z * z * z * z / (a * a * a);
+	m_t[m_count] = (start - m_first + m_len / 2.0) / m_sample_rate;
+	m_count += 1;
+
+	return 0;
+}
+
+
+/*
+ * Magnitude of the combined periodogram d Hz from the reference.
+ */
+double fcch_combiner::power(const double d) {
+
+	unsigned int i;
+	double ph;
+	std::complex<double> sum(0.0, 0.0);
+
+	for(i = 0; i < m_count; i++) {
+		ph = -4.0 * 2.0 * M_PI * d * m_t[i];
+		sum += m_w[i] * std::complex<double>(cos(ph), sin(ph));
+	}
+
+	return abs(sum);
+}
+
+
+/*
+ * The fourth power repeats every 1 / (4 dt) Hz for bursts dt apart, so the
+ * search is kept within half of that around the mean of the phase slopes.
+ * Returns -1 if there are fewer than two bursts or they don't agree on a
+ * phase, in which case they shouldn't be combined.
+ */
+int fcch_combiner::estimate(float *offset, float *coherence) {
+
+	unsigned int i, steps, best;
+	double mean = 0.0, var = 0.0, span, dt_min = 0.0, lobe, alias, r, c,
+	   step, d, p, p_best, total = 0.0, lo, hi, x1, x2, p1, p2;
+
+	if(m_count < 2)
+		return -1;
+
+	for(i = 0; i < m_count; i++)
+		mean += m_slope[i];
+	mean /= m_count;
+	for(i = 0; i < m_count; i++) {
+		var += (m_slope[i] - mean) * (m_slope[i] - mean);
+		total += abs(m_w[i]);
+		if(i && ((!dt_min) || (m_t[i] - m_t[i - 1] < dt_min)))
+			dt_min = m_t[i] - m_t[i - 1];
+	}
+	var /= m_count - 1;
+	span = m_t[m_count - 1] - m_t[0];
+	if((span <= 0.0) || (dt_min <= 0.0))
+		return -1;
+
+	lobe = 1.0 / (4.0 * span);
+	alias = 1.0 / (4.0 * dt_min);
+	r = 3.0 * sqrt(var / m_count);
+	if(r < lobe)
+		r = lobe;
+	if(r > alias / 2.0)
+		r = alias / 2.0;
+
+	// coarse grid, then golden section around the best point
+	c = mean;
+	step = lobe / 8.0;
+	steps = (unsigned int)ceil(2.0 * r / step);
+	for(i = 0, best = 0, p_best = -1.0; i <= steps; i++) {
+		p = power(c - r + i * step);
+		if(p > p_best) {
+			p_best = p;
+			best = i;
+		}
+	}
+	d = c - r + best * step;
+	lo = d - step;
+	hi = d + step;
+	x1 = hi - GOLDEN * (hi - lo);
+	x2 = lo + GOLDEN * (hi - lo);
+	p1 = power(x1);
+	p2 = power(x2);
+	for(i = 0; i < 40; i++) {
+		if(p1 > p2) {
+			hi = x2;
+			x2 = x1;
+			p2 = p1;
+			x1 = hi - GOLDEN * (hi - lo);
+			p1 = power(x1);
+		} else {
+			lo = x1;
+			x1 = x2;
+			p1 = p2;
+			x2 = lo + GOLDEN * (hi - lo);
+			p2 = power(x2);
+		}
+	}
+	d = (lo + hi) / 2.0;
+	p = power(d);
+
+	if(coherence)
+		*coherence = p / total;
+	if(p < COHERENCE_MIN * total)
+		return -1;
+
+	*offset = m_ref + d;
+
+	return 0;
+}
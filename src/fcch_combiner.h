@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fcch_combiner
+ *
+ * Joint frequency estimate from several FCCH bursts of one continuous
+ * capture.  Each burst is the tone at GSM_RATE / 4 plus the offset, and
+ * between two bursts the modulator has only moved the phase by whole
+ * symbols, so by a multiple of pi / 2.  Raising the phasor of each burst to
+ * the fourth power removes that, leaving a phase that follows the offset
+ * across the whole capture instead of across one burst.
+ *
+ * The bursts are measured on the TDMA schedule of the first: each window
+ * is a whole number of frames after it, over the middle of the burst.
+ * The offset is the peak of the combined periodogram of the phasors,
+ * searched around the mean of the phase slopes within each burst.
+ */
+
+#pragma once
+
+#include "usrp_complex.h"
+
+class fcch_combiner {
+public:
+	fcch_combiner(const float sample_rate, const unsigned int max_bursts);
+	~fcch_combiner();
+
+	void reset();
+	int add(const complex *s, const unsigned int s_len, const double center,
+	   const float offset);
+	unsigned int count();
+	int estimate(float *offset, float *coherence = 0);
+
+	static const float COHERENCE_MIN = 0.5;
+
+private:
+	double power(const double d);
+
+	float		m_sample_rate,
+			m_sps;
+	unsigned int	m_max,
+			m_count,
+			m_len;		// window length
+	double		m_ref,		// offset the bursts are mixed down by
+			m_first,	// first sample of the first window
+			*m_t,		// time of each window from the first
+			*m_slope;	// offset within each burst from m_ref
+	std::complex<double> *m_w,	// fourth power phasors
+			*m_r;		// window mixed down
+};
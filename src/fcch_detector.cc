@@ -43,15 +43,26 @@
 
 #include <stdio.h>	// for debug
 #include <stdlib.h>
+#include <assert.h>
 
 #include <stdexcept>
 #include <string.h>
+#include <pthread.h>
 #include "fcch_detector.h"
+#include "peak_detect.h"
+#include "profile.h"
+#include "rt.h"
 
 extern int g_debug;
 
 static const char * const fftw_plan_name = ".kal_fftw_plan";
 
+// most taps the block filter takes a runtime geometry with
+static const unsigned int W_MAX = 64;
+
+// the FFTW planner is not thread-safe, only fftw_execute is
+static pthread_mutex_t g_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 fcch_detector::fcch_detector(const float sample_rate, const unsigned int D,
    const float p, const float G) {
@@ -82,9 +93,12 @@ fcch_detector::fcch_detector(const float sample_rate, const unsigned int D,
 	m_out = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * FFT_SIZE);
 	if((!m_in) || (!m_out))
 		throw std::runtime_error("fcch_detector: fftw_malloc failed!");
+	rt_memory(m_in, sizeof(fftw_complex) * FFT_SIZE);
+	rt_memory(m_out, sizeof(fftw_complex) * FFT_SIZE);
 
+	pthread_mutex_lock(&g_plan_mutex);
 	home = getenv("HOME");
-	if(strlen(home) + strlen(fftw_plan_name) + 2 < sizeof(plan_name)) {
+	if(home && strlen(home) + strlen(fftw_plan_name) + 2 < sizeof(plan_name)) {
 		strcpy(plan_name, home);
 		strcat(plan_name, "/");
 		strcat(plan_name, fftw_plan_name);
@@ -101,6 +115,7 @@ fcch_detector::fcch_detector(const float sample_rate, const unsigned int D,
 	} else
 		m_plan = fftw_plan_dft_1d(FFT_SIZE, m_in, m_out, FFTW_FORWARD,
 		   FFTW_ESTIMATE);
+	pthread_mutex_unlock(&g_plan_mutex);
 	if(!m_plan)
 		throw std::runtime_error("fcch_detector: fftw plan failed!");
 }
@@ -124,6 +139,26 @@ fcch_detector::~fcch_detector() {
 		delete m_e_cb;
 		m_e_cb = 0;
 	}
+	pthread_mutex_lock(&g_plan_mutex);
+	if(m_plan)
+		fftw_destroy_plan(m_plan);
+	pthread_mutex_unlock(&g_plan_mutex);
+	fftw_free(m_in);
+	fftw_free(m_out);
+}
+
+
+/*
+ * Forgets the adapted filter and any buffered samples, as if newly made,
+ * before moving on to an unrelated stream.
+ */
+void fcch_detector::reset() {
+
+	memset(m_w, 0, sizeof(complex) * m_w_len);
+	m_e = 0.0;
+	m_x_cb->flush();
+	m_y_cb->flush();
+	m_e_cb->flush();
 }
 
 
@@ -132,34 +167,36 @@ enum {
 	HIGH	= 1
 };
 
-static unsigned int g_count = 0,
-		    g_block_s = HIGH;
+struct low_to_high_state {
+	unsigned int	count,
+			block_s;
+};
 
 
-static inline void low_to_high_init() {
+static inline void low_to_high_init(low_to_high_state *st) {
 
-	g_count = 0;
-	g_block_s = HIGH;
+	st->count = 0;
+	st->block_s = HIGH;
 }
 
 
-static inline unsigned int low_to_high(float e, float a) {
+static inline unsigned int low_to_high(low_to_high_state *st, float e, float a) {
 
 	unsigned int r = 0;
 
 	if(e > a) {
-		if(g_block_s == LOW) {
-			r = g_count;
-			g_block_s = HIGH;
-			g_count = 0;
+		if(st->block_s == LOW) {
+			r = st->count;
+			st->block_s = HIGH;
+			st->count = 0;
 		}
-		g_count += 1;
+		st->count += 1;
 	} else {
-		if(g_block_s == HIGH) {
-			g_block_s = LOW;
-			g_count = 0;
+		if(st->block_s == HIGH) {
+			st->block_s = LOW;
+			st->count = 0;
 		}
-		g_count += 1;
+		st->count += 1;
 	}
 
 	return r;
@@ -196,79 +233,6 @@ static inline int peak_valley(complex *c, unsigned int c_len, complex peak, unsi
 }
 
 
-static inline float sinc(const float x) {
-
-	if((x <= -0.0001) || (0.0001 <= x))
-		return sinf(x) / x;
-	return 1.0;
-}
-
-
-static inline complex interpolate_point(const complex *s, const unsigned int s_len, const float s_i) {
-
-	static const unsigned int filter_len = 21;
-
-	int start, end, i;
-	unsigned int d;
-	complex point;
-
-	d = (filter_len - 1) / 2;
-	start = (int)(floor(s_i) - d);
-	end = (int)(floor(s_i) + d + 1);
-	if(start < 0)
-		start = 0;
-	if(end > (int)(s_len - 1))
-		end = s_len - 1;
-	for(point = 0.0, i = start; i <= end; i++)
-		point += s[i] * sinc(M_PI * (i - s_i));
-	return point;
-}
-
-
-static inline float peak_detect(const complex *s, const unsigned int s_len, complex *peak, float *avg_power) {
-
-	unsigned int i;
-	float max = -1.0, max_i = -1.0, sample_power, sum_power, early_i, late_i, incr;
-	complex early_p, late_p, cmax;
-
-	sum_power = 0;
-	for(i = 0; i < s_len; i++) {
-		sample_power = norm(s[i]);
-		sum_power += sample_power;
-		if(sample_power > max) {
-			max = sample_power;
-			max_i = i;
-		}
-	}
-	early_i = (1 <= max_i)? (max_i - 1) : 0;
-	late_i = (max_i + 1 < s_len)? (max_i + 1) : s_len - 1;
-
-	incr = 0.5;
-	while(incr > 1.0 / 1024.0) {
-		early_p = interpolate_point(s, s_len, early_i);
-		late_p = interpolate_point(s, s_len, late_i);
-		if(norm(early_p) < norm(late_p))
-			early_i += incr;
-		else if(norm(early_p) > norm(late_p))
-			early_i -= incr;
-		else
-			break;
-		incr /= 2.0;
-		late_i = early_i + 2.0;
-	}
-	max_i = early_i + 1.0;
-	cmax = interpolate_point(s, s_len, max_i);
-
-	if(peak)
-		*peak = cmax;
-
-	if(avg_power)
-		*avg_power = (sum_power - norm(cmax)) / (s_len - 1);
-
-	return max_i;
-}
-
-
 static inline float itof(float index, float sample_rate, unsigned int fft_size) {
 
 	double r = index * (sample_rate / (double)fft_size);
@@ -301,6 +265,9 @@ float fcch_detector::freq_detect(const complex *s, const unsigned int s_len, flo
 	unsigned int i, len;
 	float max_i, avg_power;
 	complex fft[FFT_SIZE], peak;
+	profile_timer pt(PROF_FFT, s_len);
+
+	profile_count(PROF_FFTS);
 
 	len = MIN(s_len, FFT_SIZE);
 	for(i = 0; i < len; i++) {
@@ -342,24 +309,47 @@ static inline void display_complex(const complex *s, unsigned int s_len) {
  * 	3.  for each such neighborhood, take fft and calculate peak/mean
  * 	4.  if peak/mean > 50, then this is a valid finding.
  */
-unsigned int fcch_detector::scan(const complex *s, const unsigned int s_len, float *offset, unsigned int *consumed) {
+unsigned int fcch_detector::scan(const complex *s, const unsigned int s_len, float *offset, unsigned int *consumed, unsigned int *position) {
+
+	fcch_burst b;
+
+	if(!scan_all(s, s_len, &b, 1, consumed))
+		return 0;
+
+	if(offset)
+		*offset = b.offset;
+
+	// approximate start of the burst in s
+	if(position)
+		*position = b.position;
+
+	return 1;
+}
 
-	static const float sps = m_sample_rate / (1625000.0 / 6.0);
-	static const unsigned int MIN_FB_LEN = 100 * sps;
-	static const unsigned int MIN_PM = 50; // XXX arbitrary, depends on decimation
 
-	unsigned int len = 0, t, e_count, i, l_count, y_offset, y_len;
-	float e, *a, loff = 0, pm;
+/*
+ * As scan() but carries on past the first burst, filling in up to max
+ * bursts in the order they appear in s.  Returns the number found.
+ */
+unsigned int fcch_detector::scan_all(const complex *s, const unsigned int s_len, fcch_burst *bursts, const unsigned int max, unsigned int *consumed) {
+
+	const float sps = m_sample_rate / (1625000.0 / 6.0);
+	const unsigned int MIN_FB_LEN = 100 * sps;
+
+	unsigned int len = 0, e_count, i, l_count, y_offset, y_len, n = 0;
+	float *a, loff, pm;
 	double sum = 0.0, avg, limit;
 	const complex *y;
+	low_to_high_state lh;
+	profile_timer pt(PROF_SCAN, s_len);
 
 	// calculate the error for each sample
-	while(len < s_len) {
-		t = m_x_cb->write(s + len, 1);
-		len += t;
-		if(!next_norm_error(&e)) {
-			m_e_cb->write(&e, 1);
-			sum += e;
+	{
+		profile_timer pt(PROF_LMS, s_len);
+
+		while(len < s_len) {
+			len += m_x_cb->write(s + len, s_len - len);
+			sum += filter_block();
 		}
 	}
 	if(consumed)
@@ -375,21 +365,27 @@ unsigned int fcch_detector::scan(const complex *s, const unsigned int s_len, flo
 	}
 
 	// find neighborhoods where the error is smaller than the limit
-	low_to_high_init();
-	for(i = 0; i < e_count; i++) {
-		l_count = low_to_high(a[i], limit);
+	low_to_high_init(&lh);
+	for(i = 0; (i < e_count) && (n < max); i++) {
+		l_count = low_to_high(&lh, a[i], limit);
 
 		// see if p/m indicates a pure tone
-		pm = 0;
 		if(l_count >= MIN_FB_LEN) {
 			y_offset = i - l_count;
 			y_len = (l_count < m_fcch_burst_len)? l_count : m_fcch_burst_len;
 			y = s + y_offset;
 			loff = freq_detect(y, y_len, &pm);
+			profile_count(PROF_CANDIDATES);
+			profile_pm(pm);
 			if(g_debug)
 				printf("debug: %.0f\t%f\t%f\n", (double)l_count / sps, pm, loff);
-			if(pm > MIN_PM)
-				break;
+			if(pm > MIN_PM) {
+				bursts[n].position = y_offset;
+				bursts[n].len = l_count;
+				bursts[n].offset = loff;
+				bursts[n].pm = pm;
+				n += 1;
+			}
 		}
 	}
 	// empty buffers for next call
@@ -397,17 +393,15 @@ unsigned int fcch_detector::scan(const complex *s, const unsigned int s_len, flo
 	m_x_cb->flush();
 	m_y_cb->flush();
 
-	if(pm <= MIN_PM)
+	if(!n)
 		return 0;
-
-	if(offset)
-		*offset = loff;
+	profile_count(PROF_DETECTIONS, n);
 
 	if(g_debug) {
 		printf("debug: fcch_detector finished -----------------------------\n");
 	}
 
-	return 1;
+	return n;
 }
 
 
@@ -423,6 +417,18 @@ unsigned int fcch_detector::get_delay() {
 }
 
 
+/*
+ * Samples from the end of one scan() buffer to scan again at the start of
+ * the next, so that a burst cut off by the end of the buffer is seen whole:
+ * the burst, the filter history and time for the averaged error to rise
+ * again after it.
+ */
+unsigned int fcch_detector::overlap() {
+
+	return m_fcch_burst_len + get_delay() + (unsigned int)(2.0 / m_p);
+}
+
+
 unsigned int fcch_detector::filter_len() {
 
 	return m_w_len;
@@ -441,6 +447,125 @@ static float vectornorm2(const complex *v, const unsigned int len) {
 }
 
 
+/*
+ * The adaptive filter of next_norm_error() run over count consecutive
+ * samples, leaving the error ratios in error.  x starts with the
+ * w_len - 1 + D samples of history the first needs.
+ *
+ * W and DD fix the geometry at compile time; with W 0 the runtime w_len
+ * and d are used instead, up to W_MAX taps.  With the geometry fixed the
+ * loops over the taps have constant trip counts and the weights live in a
+ * local array, so the compiler unrolls the loops and keeps as much of the
+ * weights in registers as it can.  The arithmetic is next_norm_error()'s
+ * written out on the real and imaginary parts, in the same order, so
+ * every path gives the same errors.
+ */
+template <unsigned int W, unsigned int DD>
+static void lms_errors(const complex *x, unsigned int count,
+   unsigned int w_len_rt, unsigned int d_rt, complex *w, float *G,
+   float *e_avg, const float p, float *error) {
+
+	const unsigned int w_len = W? W : w_len_rt, D = W? DD : d_rt;
+
+	unsigned int k, i;
+	float wr[W? W : W_MAX], wi[W? W : W_MAX], g = *G, m_e = *e_avg, E,
+	   yr, yi, er, ei, ar, ai, xr, xi;
+	const complex *xn;
+
+	assert(w_len <= (W? W : W_MAX));
+	for(i = 0; i < w_len; i++) {
+		wr[i] = w[i].real();
+		wi[i] = w[i].imag();
+	}
+
+	for(k = 0; k < count; k++) {
+		xn = x + k + w_len - 1;
+
+		E = 0.0;
+		for(i = 0; i < w_len; i++) {
+			xr = x[k + i].real();
+			xi = x[k + i].imag();
+			E += xr * xr + xi * xi;
+		}
+		if(g >= 2.0 / E)
+			g = 1.0 / E;
+
+		// y = sum conj(w[i]) * x[n - i]
+		yr = 0.0;
+		yi = 0.0;
+		for(i = 0; i < w_len; i++) {
+			xr = xn[-(int)i].real();
+			xi = xn[-(int)i].imag();
+			yr += wr[i] * xr + wi[i] * xi;
+			yi += wr[i] * xi - wi[i] * xr;
+		}
+
+		er = xn[D].real() - yr;
+		ei = xn[D].imag() - yi;
+
+		// w[i] += G * conj(e) * x[n - i]
+		ar = g * er;
+		ai = g * -ei;
+		for(i = 0; i < w_len; i++) {
+			xr = xn[-(int)i].real();
+			xi = xn[-(int)i].imag();
+			wr[i] += ar * xr - ai * xi;
+			wi[i] += ar * xi + ai * xr;
+		}
+
+		E /= w_len;
+		m_e = (1.0 - p) * m_e + p * (er * er + ei * ei);
+		error[k] = m_e / E;
+	}
+
+	for(i = 0; i < w_len; i++)
+		w[i] = complex(wr[i], wi[i]);
+	*G = g;
+	*e_avg = m_e;
+}
+
+
+/*
+ * next_norm_error() for every sample in the x buffer that has a full
+ * window, appending the errors to the e buffer.  Returns their sum.  This
+ * is what scan() runs; it is public so kal_bench can time it against
+ * next_norm_error().
+ */
+double fcch_detector::filter_block() {
+
+	static const unsigned int CHUNK = 1024;
+
+	unsigned int hist = m_w_len - 1 + m_D, avail, count, i;
+	float error[CHUNK];
+	double sum = 0.0;
+	complex *x;
+
+	x = (complex *)m_x_cb->peek(&avail);
+	while(avail > hist) {
+		count = (avail - hist < CHUNK)? avail - hist : CHUNK;
+
+		if((m_w_len == FIXED_W_LEN) && (m_D == FIXED_D)) {
+			lms_errors<FIXED_W_LEN, FIXED_D>(x, count, m_w_len, m_D,
+			   m_w, &m_G, &m_e, m_p, error);
+		} else {
+			lms_errors<0, 0>(x, count, m_w_len, m_D, m_w, &m_G, &m_e,
+			   m_p, error);
+		}
+
+		m_y_cb->write(x + hist, count);
+		m_e_cb->write(error, count);
+		for(i = 0; i < count; i++)
+			sum += error[i];
+
+		m_x_cb->purge(count);
+		x += count;
+		avail -= count;
+	}
+
+	return sum;
+}
+
+
 /*
  * First y value comes out at sample x[n + m_D] = x[w_len - 1 + m_D].
  *
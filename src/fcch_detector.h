@@ -46,15 +46,25 @@
 #include "circular_buffer.h"
 #include "usrp_complex.h"
 
+struct fcch_burst {
+	unsigned int	position,	// approximate start in the buffer
+			len;		// samples the error stayed low
+	float		offset,		// frequency of the tone
+			pm;
+};
+
 class fcch_detector {
 
 public:
 	fcch_detector(const float sample_rate, const unsigned int D = 8, const float p = 1.0 / 32.0, const float G = 1.0 / 12.5);
 	~fcch_detector();
-	unsigned int scan(const complex *s, const unsigned int s_len, float *offset, unsigned int *consumed);
+	void reset();
+	unsigned int scan(const complex *s, const unsigned int s_len, float *offset, unsigned int *consumed, unsigned int *position = 0);
+	unsigned int scan_all(const complex *s, const unsigned int s_len, fcch_burst *bursts, const unsigned int max, unsigned int *consumed);
 	float freq_detect(const complex *s, const unsigned int s_len, float *pm);
 	unsigned int update(const complex *s, unsigned int s_len);
 	int next_norm_error(float *error);
+	double filter_block();
 	complex *dump_x(unsigned int *);
 	complex *dump_y(unsigned int *);
 	unsigned int filter_delay() { return m_filter_delay; };
@@ -63,11 +73,18 @@ public:
 	unsigned int x_buf_len();
 	unsigned int y_buf_len();
 	unsigned int x_purge(unsigned int);
+	unsigned int overlap();
+
+	static const unsigned int MIN_PM = 50; // XXX arbitrary, depends on decimation
 
 private:
 	static const double GSM_RATE = 1625000.0 / 6.0;
 	static const unsigned int FFT_SIZE = 1024;
 
+	// the geometry scan() has a specialized filter for
+	static const unsigned int FIXED_W_LEN = 17;
+	static const unsigned int FIXED_D = 8;
+
 	unsigned int	m_w_len,
 			m_D,
 			m_check_G,
@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "file_source.h"
+#include "profile.h"
+
+extern int g_verbosity;
+
+static const long DECODERS_MAX = 4;
+
+
+file_source::file_source(float sample_rate, const std::string args) :
+   usrp_source(sample_rate, 0, false, args) {
+
+	char buf[BUFSIZ], *tok, *val, *save;
+
+	m_format = FORMAT_SC16;
+	m_decoders = -1;
+	m_loop = true;
+	m_have_rate = false;
+	m_bad_args = false;
+	m_iq = 0;
+	m_block = 0;
+	m_block_first = 0;
+	m_map = 0;
+	m_map_len = 0;
+	m_count = 0;
+	m_pos = 0;
+	m_index = 0;
+	m_device_rate = sample_rate;
+
+	strncpy(buf, args.c_str(), sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(0, ",", &save)) {
+		if(!(val = strchr(tok, '=')))
+			continue;
+		*val++ = 0;
+		if(!strcmp(tok, "file"))
+			m_path = val;
+		else if(!strcmp(tok, "rate")) {
+			m_device_rate = strtod(val, 0);
+			m_have_rate = true;
+		} else if(!strcmp(tok, "format")) {
+			if(!strcmp(val, "fc32"))
+				m_format = FORMAT_FC32;
+			else if(strcmp(val, "sc16")) {
+				fprintf(stderr, "error: file_source: bad format: "
+				   "``%s''\n", val);
+				m_bad_args = true;
+			}
+		} else if(!strcmp(tok, "loop"))
+			m_loop = strtol(val, 0, 0);
+		else if(!strcmp(tok, "decoders"))
+			m_decoders = strtol(val, 0, 0);
+	}
+}
+
+
+file_source::~file_source() {
+
+	delete m_iq;
+	if(m_map)
+		munmap(m_map, m_map_len);
+}
+
+
+int file_source::open(unsigned int subdev) {
+
+	struct stat st;
+	int fd;
+	size_t sample_size;
+	long n;
+
+	if(m_map)
+		return 0;
+
+	// already reported by the constructor
+	if(m_bad_args)
+		return -1;
+
+	if((fd = ::open(m_path.c_str(), O_RDONLY)) < 0) {
+		fprintf(stderr, "error: file_source: %s: %s\n", m_path.c_str(),
+		   strerror(errno));
+		return -1;
+	}
+	if(fstat(fd, &st) || (!st.st_size)) {
+		fprintf(stderr, "error: file_source: %s: empty or unreadable\n",
+		   m_path.c_str());
+		close(fd);
+		return -1;
+	}
+
+	m_map_len = st.st_size;
+	m_map = mmap(0, m_map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(m_map == MAP_FAILED) {
+		m_map = 0;
+		fprintf(stderr, "error: file_source: mmap: %s\n", strerror(errno));
+		return -1;
+	}
+	madvise(m_map, m_map_len, MADV_SEQUENTIAL);
+
+	if((m_map_len >= 4) && (!memcmp(m_map, "KALQ", 4))) {
+		// a decoder per CPU but ours, up to DECODERS_MAX
+		if((n = m_decoders) < 0) {
+			n = 0;
+			if(!g_profile) {
+				n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+				n = (n < 1)? 1 : ((n > DECODERS_MAX)? DECODERS_MAX : n);
+			}
+		}
+		m_iq = new iq_reader;
+		if(m_iq->open(m_map, m_map_len) || m_iq->start(n)) {
+			fprintf(stderr, "error: file_source: %s: bad recording\n",
+			   m_path.c_str());
+			return -1;
+		}
+		m_count = m_iq->sample_count();
+		if(!m_have_rate)
+			m_device_rate = m_iq->rate();
+	} else {
+		sample_size = (m_format == FORMAT_FC32)? 2 * sizeof(float) : 2 * sizeof(short);
+		if(!(m_count = m_map_len / sample_size)) {
+			fprintf(stderr, "error: file_source: %s: no samples\n",
+			   m_path.c_str());
+			return -1;
+		}
+	}
+
+	resample_setup();
+	m_recv_samples_per_packet = PACKET_LEN;
+
+	if(g_verbosity > 1) {
+		fprintf(stderr, "Replaying %llu samples from %s\n", m_count,
+		   m_path.c_str());
+		fprintf(stderr, "Sample rate: %f\n", m_sample_rate);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Switches to another recording, in the same format and at the same rate,
+ * keeping the buffers we already have.  Returns -1 if it can't be opened.
+ */
+int file_source::replay(const std::string path) {
+
+	delete m_iq;
+	m_iq = 0;
+	m_block = 0;
+	if(m_map) {
+		munmap(m_map, m_map_len);
+		m_map = 0;
+	}
+	m_path = path;
+	m_count = 0;
+	m_pos = 0;
+	m_index = 0;
+
+	m_cb->flush();
+	m_sample_count = 0;
+	m_segment_count = 0;
+	if(m_resampler)
+		m_resampler->reset();
+	m_in_timed = false;
+
+	return open(0);
+}
+
+
+/*
+ * Samples left before the end of the recording.
+ */
+unsigned long long file_source::remaining() {
+
+	return m_count - m_pos;
+}
+
+
+/*
+ * The decoded block of a compact recording holding m_pos, with the sample
+ * it starts at in first.  Returns 0 if it couldn't be decoded.
+ */
+const iq_block *file_source::block(unsigned long long *first) {
+
+	if((!m_block) || (m_pos < m_block_first) ||
+	   (m_pos >= m_block_first + m_block->samples))
+		m_block = m_iq->get(m_iq->block_of(m_pos, &m_block_first));
+	*first = m_block_first;
+
+	return m_block;
+}
+
+
+/*
+ * Copies up to len samples from the file into the buffer.  Returns the
+ * number copied, or -1 at the end of the file if we aren't looping; that
+ * is for the caller to report, as reaching it may be expected.
+ */
+int file_source::read_packet(unsigned int len) {
+
+	complex *c;
+	unsigned int i;
+	const iq_block *b = 0;
+	unsigned long long first = 0;
+
+	if(m_pos >= m_count) {
+		if(!m_loop)
+			return -1;
+		m_pos = 0;
+	}
+	if(len > m_count - m_pos)
+		len = m_count - m_pos;
+	if(m_iq) {
+		if(!(b = block(&first)))
+			return -1;
+		if(len > first + b->samples - m_pos)
+			len = first + b->samples - m_pos;
+	}
+
+	c = input_buffer(&len);
+	{
+		profile_timer pt(PROF_CONVERT, len);
+
+		if(b)
+			m_iq->convert(b, m_pos - first, c, len);
+		else if(m_format == FORMAT_FC32) {
+			const float *f = (const float *)m_map + 2 * m_pos;
+			for(i = 0; i < len; i++)
+				c[i] = complex(f[2 * i], f[2 * i + 1]);
+		} else
+			sc16_to_fc32((const short *)m_map + 2 * m_pos, c, len);
+	}
+	commit(len, true, m_index / (double)m_device_rate);
+	m_pos += len;
+	m_index += len;
+
+	return len;
+}
+
+
+/*
+ * Passes over len samples, to the end at most if we aren't looping.
+ */
+void file_source::skip(unsigned long long len) {
+
+	m_index += len;
+	if(m_loop)
+		m_pos = (m_pos + len) % m_count;
+	else
+		m_pos = (len < m_count - m_pos)? m_pos + len : m_count;
+}
+
+
+int file_source::fill(unsigned int num_samples, unsigned int *overrun) {
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	if(overrun)
+		*overrun = 0;
+
+	while((m_cb->data_available() < num_samples) &&
+	   (m_cb->space_available() > 0)) {
+		if(read_packet(PACKET_LEN) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+int file_source::capture(double when, unsigned int num_samples, unsigned int *overrun) {
+
+	unsigned long long start;
+	unsigned int len, num_device;
+	int r;
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	if(overrun)
+		*overrun = 0;
+
+	m_streaming = false;
+	if(m_cb->space_available() < num_samples) {
+		fprintf(stderr, "error: file_source::capture: no space\n");
+		return -1;
+	}
+
+	num_device = device_samples(num_samples, &when);
+	start = (unsigned long long)ceil(when * m_device_rate);
+	if(start < m_index)
+		return 1;
+
+	skip(start - m_index);
+	while(num_device) {
+		len = (num_device < PACKET_LEN)? num_device : PACKET_LEN;
+		if((r = read_packet(len)) < 0)
+			return -1;
+		num_device -= r;
+	}
+
+	return 0;
+}
+
+
+int file_source::tune(double freq) {
+
+	profile_timer pt(PROF_TUNE);
+
+	return (int)freq;
+}
+
+
+void file_source::set_antenna(int antenna) {
+
+}
+
+
+void file_source::set_antenna(const std::string antenna) {
+
+}
+
+
+std::vector<std::string> file_source::get_antennas() {
+
+	return std::vector<std::string>(1, "RX2");
+}
+
+
+bool file_source::set_gain(float gain) {
+
+	return (0.0 <= gain) && (gain <= 1.0);
+}
+
+
+bool file_source::has_gain() {
+
+	return false;
+}
+
+
+void file_source::start() {
+
+	m_streaming = true;
+}
+
+
+void file_source::stop() {
+
+	m_streaming = false;
+}
+
+
+double file_source::time_now() {
+
+	return m_index / (double)m_device_rate;
+}
+
+
+bool file_source::exhausted() {
+
+	return (!m_loop) && (m_pos >= m_count);
+}
+
+
+/*
+ * Nothing in a recording goes stale, so unlike a device there is nothing
+ * to drain: only the buffer is emptied.
+ */
+int file_source::flush(unsigned int flush_count) {
+
+	m_cb->flush();
+	m_sample_count = 0;
+	m_segment_count = 0;
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * file_source
+ *
+ * Replays a recording in place of the USRP, as fast as the samples are
+ * consumed.  Selected with device arguments starting with "file=", for
+ * example
+ *
+ *	file=capture.dat,rate=270833.333,format=sc16
+ *
+ * format is sc16 (interleaved 16-bit I/Q, what the device delivers, the
+ * default) or fc32 (interleaved floats).  rate is the rate the recording
+ * was made at and defaults to the rate kal asks for.  The recording is
+ * looped unless loop=0 is given, in which case running off the end is an
+ * error.  Tuning is ignored: every channel sees the same recording.
+ *
+ * Compact recordings made with -O (see iq_file.h) are recognized whatever
+ * the format given, and have their rate unless rate= is given.  Their
+ * blocks are decoded ahead by decoders= threads, one per CPU but one up to
+ * four by default; with decoders=0 each is decoded as it is reached.
+ *
+ * As with sim_source the device clock is the sample count.
+ */
+
+#pragma once
+
+#include "usrp_source.h"
+#include "iq_file.h"
+
+class file_source : public usrp_source {
+public:
+	file_source(float sample_rate, const std::string args);
+	~file_source();
+
+	int open(unsigned int subdev);
+	int fill(unsigned int num_samples, unsigned int *overrun);
+	int capture(double when, unsigned int num_samples, unsigned int *overrun);
+	int tune(double freq);
+	void set_antenna(int antenna);
+	void set_antenna(const std::string antenna);
+	std::vector<std::string> get_antennas();
+	bool set_gain(float gain);
+	bool has_gain();
+	void start();
+	void stop();
+	double time_now();
+	bool exhausted();
+	int flush(unsigned int flush_count = FLUSH_COUNT);
+
+	int replay(const std::string path);
+	unsigned long long remaining();
+
+	enum {
+		FORMAT_SC16,
+		FORMAT_FC32
+	};
+
+private:
+	int read_packet(unsigned int len);
+	void skip(unsigned long long len);
+	const iq_block *block(unsigned long long *first);
+
+	std::string			m_path;
+	int				m_format,
+					m_decoders;
+	bool				m_loop,
+					m_have_rate,
+					m_bad_args;
+	void *				m_map;
+	size_t				m_map_len;
+	unsigned long long		m_count,	// samples in the file
+					m_pos,		// next sample to read
+					m_index;	// samples delivered
+
+	// a compact recording, and the block m_pos is in
+	iq_reader *			m_iq;
+	const iq_block *		m_block;
+	unsigned long long		m_block_first;
+
+	static const unsigned int	PACKET_LEN	= 1000;
+};
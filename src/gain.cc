@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "usrp_source.h"
+#include "profile.h"
+#include "gain.h"
+#include "util.h"
+
+// devices with a gain deliver sc16, and the resampler keeps the scale
+static const float		FULL_SCALE	= 32767.0;
+static const float		PEAK_MAX	= FULL_SCALE / 2.0;
+static const float		RANGE_DB	= 18.0;
+static const unsigned int	RANGE_STEPS	= 8;
+static const unsigned int	OVERRUN_MAX	= 10;	// captures in a row
+
+extern int g_verbosity;
+
+
+/*
+ * Largest magnitude of I or Q, which is what clips, and the RMS of the
+ * complex samples.
+ */
+void gain_level(const complex *b, unsigned int len, float *peak, float *rms) {
+
+	unsigned int i;
+	float p = 0.0;
+	double sum = 0.0;
+
+	for(i = 0; i < len; i++) {
+		if(fabsf(b[i].real()) > p)
+			p = fabsf(b[i].real());
+		if(fabsf(b[i].imag()) > p)
+			p = fabsf(b[i].imag());
+		sum += norm(b[i]);
+	}
+
+	if(peak)
+		*peak = p;
+	if(rms)
+		*rms = len? sqrt(sum / len) : 0.0;
+}
+
+
+/*
+ * Returns 1 if the capture in b is neither near clipping nor more than
+ * RANGE_DB below it.
+ */
+int gain_ok(const complex *b, unsigned int len) {
+
+	float peak;
+
+	gain_level(b, len, &peak, 0);
+
+	return (peak < PEAK_MAX) &&
+	   (peak >= PEAK_MAX * pow(10.0, -RANGE_DB / 20.0));
+}
+
+
+/*
+ * Bisects the gain, starting from *gain, until a capture is within range or
+ * RANGE_STEPS have been tried, and leaves the device at the highest gain
+ * that didn't come near clipping.  The stream must be running and tuned.
+ * Returns -1 if the device fails, or if OVERRUN_MAX captures in a row
+ * overrun.
+ */
+int gain_range(usrp_source *u, float *gain) {
+
+	unsigned int i, k, len, b_len, overruns;
+	float g = *gain, lo = 0.0, hi = 1.0, best = -1.0, tried = -1.0, peak,
+	   rms;
+	complex *b;
+	profile_timer pt(PROF_GAIN);
+
+	// 12 frames, so every timeslot of the carrier is in the capture
+	len = (unsigned int)ceil(12 * 8 * 156.25 * u->sample_rate() / GSM_RATE);
+
+	for(i = 0; i < RANGE_STEPS; i++) {
+		if(!u->set_gain(g))
+			return -1;
+		tried = g;
+		k = 0;
+		do {
+			if(k++ >= OVERRUN_MAX) {
+				fprintf(stderr, "error: gain: every capture "
+				   "overruns\n");
+				return -1;
+			}
+			u->flush();
+			if(u->fill(len, &overruns))
+				return -1;
+		} while(overruns);
+		b = (complex *)u->get_buffer()->peek(&b_len);
+		gain_level(b, len, &peak, &rms);
+
+		if(g_verbosity > 1) {
+			fprintf(stderr, "\tgain %.1f%%: peak %.0f, rms %.0f\n",
+			   100.0 * g, peak, rms);
+		}
+
+		if(peak >= PEAK_MAX)
+			hi = g;
+		else {
+			lo = g;
+			best = g;
+			if(peak >= PEAK_MAX * pow(10.0, -RANGE_DB / 20.0))
+				break;
+		}
+		g = (lo + hi) / 2.0;
+	}
+
+	// even the least gain clips, which is the best we can do
+	if(best < 0.0) {
+		fprintf(stderr, "warning: signal clips at the lowest gain\n");
+		best = 0.0;
+	}
+
+	if(best != tried) {
+		if(!u->set_gain(best))
+			return -1;
+		u->flush();
+	}
+	*gain = best;
+
+	return 0;
+}
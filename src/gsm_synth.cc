@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "gsm_synth.h"
+#include "util.h"
+
+static const unsigned int FRAME_LEN = 1250;
+static const unsigned int BURST_LEN = 148;
+static const unsigned int TN0_LEN = 157;
+static const float BT = 0.3;
+
+static const unsigned char sch_training[] = {
+	1, 0, 1, 1, 1, 0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 0,
+	0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+	0, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1,
+	0, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 1, 1
+};
+
+
+static inline unsigned long long mix(unsigned long long x) {
+
+	// splitmix64 finalizer
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+
+gsm_synth::gsm_synth(const float sample_rate, const float offset,
+   const float snr, const float amplitude, const int bsic,
+   const unsigned int fn, const unsigned int seed) {
+
+	unsigned int j;
+	double t, g, sum = 0.0, k = 2.0 * M_PI * BT / sqrt(log(2.0));
+
+	m_sample_rate = sample_rate;
+	m_sps = sample_rate / GSM_RATE;
+	m_offset = offset;
+	m_snr = snr;
+	m_bsic = bsic;
+	m_carrier = true;
+	m_fn = fn;
+	m_seed = seed;
+	set_amplitude(amplitude);
+
+	// integrate the gaussian frequency pulse
+	for(j = 0; j <= 2 * Q_SPAN * Q_RES; j++) {
+		t = -(double)Q_SPAN + (double)j / Q_RES;
+		g = 0.5 * (erfc(k * (t - 0.5) / M_SQRT2) - erfc(k * (t + 0.5) / M_SQRT2)) / 2.0;
+		sum += g / Q_RES;
+		m_q[j] = sum;
+	}
+	for(j = 0; j <= 2 * Q_SPAN * Q_RES; j++)
+		m_q[j] /= sum;
+
+	m_phase_frame = 0;
+	m_phase = 0.0;
+	m_sch_frame = ~0ULL;
+}
+
+
+gsm_synth::~gsm_synth() {
+
+}
+
+
+void gsm_synth::set_offset(const float offset) {
+
+	m_offset = offset;
+}
+
+
+/*
+ * With the carrier off only the noise is generated.
+ */
+void gsm_synth::set_carrier(const bool on) {
+
+	m_carrier = on;
+}
+
+
+void gsm_synth::set_bsic(const int bsic) {
+
+	m_bsic = bsic;
+	m_sch_frame = ~0ULL;
+}
+
+
+float gsm_synth::offset() {
+
+	return m_offset;
+}
+
+
+void gsm_synth::set_amplitude(const float amplitude) {
+
+	m_amplitude = amplitude;
+	m_noise = amplitude / sqrt(2.0 * pow(10.0, m_snr / 10.0));
+}
+
+
+/*
+ * 45.003 4.7: BSIC and reduced frame number, 10 ones'-complement parity bits,
+ * 4 tail bits, then the rate 1/2 convolutional code, laid out as a
+ * synchronization burst.
+ */
+void gsm_synth::sch_bits(const int bsic, const unsigned int fn, unsigned char *bits) {
+
+	unsigned int i, t1, t2, t3p, r, s;
+	unsigned char u[39], e[78];
+
+	t1 = fn / (26 * 51);
+	t2 = fn % 26;
+	t3p = (fn % 51 - 1) / 10;
+
+	memset(u, 0, sizeof(u));
+	for(i = 0; i < 6; i++)
+		u[2 + i] = (bsic >> i) & 1;
+	u[1] = (t1 >> 10) & 1;
+	u[0] = (t1 >> 9) & 1;
+	for(i = 0; i < 8; i++)
+		u[15 - i] = (t1 >> (8 - i)) & 1;
+	u[23] = t1 & 1;
+	for(i = 0; i < 5; i++)
+		u[18 + i] = (t2 >> i) & 1;
+	u[24] = (t3p >> 2) & 1;
+	u[17] = (t3p >> 1) & 1;
+	u[16] = t3p & 1;
+
+	// parity
+	for(r = 0, i = 0; i < 35; i++) {
+		r = (r << 1) | ((i < 25)? u[i] : 0);
+		if(r & (1 << 10))
+			r ^= 0x575;
+	}
+	r ^= (1 << 10) - 1;
+	for(i = 0; i < 10; i++)
+		u[25 + i] = (r >> (9 - i)) & 1;
+
+	// convolutional code
+	for(i = 0, s = 0; i < 39; i++) {
+		e[2 * i] = u[i] ^ ((s >> 1) & 1) ^ (s & 1);
+		e[2 * i + 1] = u[i] ^ ((s >> 3) & 1) ^ ((s >> 1) & 1) ^ (s & 1);
+		s = (u[i] << 3) | (s >> 1);
+	}
+
+	memset(bits, 0, BURST_LEN);
+	for(i = 0; i < 39; i++) {
+		bits[3 + i] = e[i];
+		bits[106 + i] = e[39 + i];
+	}
+	for(i = 0; i < 64; i++)
+		bits[42 + i] = sch_training[i];
+}
+
+
+/*
+ * Timeslots are 157, 156, 156, 156, 157, 156, 156, 156 symbols.  Only
+ * timeslot 0 carries anything we look at.
+ */
+unsigned char gsm_synth::burst_bit(const unsigned long long symbol) {
+
+	unsigned long long frame = symbol / FRAME_LEN;
+	unsigned int k = symbol % FRAME_LEN, fn, t3;
+
+	if(k < BURST_LEN) {
+		fn = (m_fn + frame) % (26 * 51 * 2048);
+		t3 = fn % 51;
+		if((t3 % 10 == 0) && (t3 <= 40))
+			return 0;
+		if((t3 % 10 == 1) && (t3 <= 41)) {
+			if(m_sch_frame != frame) {
+				sch_bits(m_bsic, fn, m_sch);
+				m_sch_frame = frame;
+			}
+			return m_sch[k];
+		}
+	} else if(k < TN0_LEN)
+		return 1;
+
+	return mix(symbol ^ ((unsigned long long)m_seed << 40)) & 1;
+}
+
+
+/*
+ * pi / 2 times the sum of the differentially encoded symbols before symbol.
+ */
+double gsm_synth::phase_at(const unsigned long long symbol) {
+
+	unsigned long long frame = symbol / FRAME_LEN, i;
+	unsigned char prev;
+	int sum;
+
+	if(frame < m_phase_frame) {
+		m_phase_frame = 0;
+		m_phase = 0.0;
+	}
+
+	while(m_phase_frame < frame) {
+		i = m_phase_frame * FRAME_LEN;
+		prev = i? burst_bit(i - 1) : 1;
+		for(sum = 0; i < (m_phase_frame + 1) * FRAME_LEN; i++) {
+			unsigned char b = burst_bit(i);
+			sum += (b ^ prev)? -1 : 1;
+			prev = b;
+		}
+		m_phase = fmod(m_phase + M_PI / 2.0 * sum, 2.0 * M_PI);
+		m_phase_frame += 1;
+	}
+
+	i = frame * FRAME_LEN;
+	prev = i? burst_bit(i - 1) : 1;
+	for(sum = 0; i < symbol; i++) {
+		unsigned char b = burst_bit(i);
+		sum += (b ^ prev)? -1 : 1;
+		prev = b;
+	}
+
+	return m_phase + M_PI / 2.0 * sum;
+}
+
+
+float gsm_synth::noise(const unsigned long long index, const unsigned int k) {
+
+	unsigned long long h = mix(index * 2 + k + ((unsigned long long)m_seed << 48));
+	double u1 = ((h >> 11) + 1.0) / 9007199254740993.0,
+	   u2 = (mix(h) >> 11) / 9007199254740992.0;
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+void gsm_synth::generate(complex *out, const unsigned int len, const unsigned long long index) {
+
+	unsigned int n, j;
+	unsigned long long base_sym, i;
+	long long first;
+	double t, tau, ph, base, w, carrier;
+	int a;
+
+	if(!m_carrier) {
+		for(n = 0; n < len; n++)
+			out[n] = complex(m_noise * noise(index + n, 0),
+			   m_noise * noise(index + n, 1));
+		return;
+	}
+
+	w = 2.0 * M_PI * m_offset / m_sample_rate;
+	t = index / m_sps;
+	first = (long long)floor(t) - (long long)Q_SPAN - 1;
+	base_sym = (first > 0)? first : 0;
+	base = phase_at(base_sym);
+
+	for(n = 0; n < len; n++) {
+		t = (index + n) / m_sps;
+
+		// symbols entirely in the past
+		first = (long long)floor(t) - (long long)Q_SPAN - 1;
+		while((first > 0) && (base_sym < (unsigned long long)first)) {
+			a = (burst_bit(base_sym) ^ (base_sym? burst_bit(base_sym - 1) : 1))? -1 : 1;
+			base += M_PI / 2.0 * a;
+			base_sym += 1;
+		}
+
+		// symbols still inside the pulse
+		ph = base;
+		for(i = base_sym; i <= (unsigned long long)floor(t) + Q_SPAN; i++) {
+			tau = t - i - 0.5;
+			if(tau <= -(double)Q_SPAN)
+				break;
+			a = (burst_bit(i) ^ (i? burst_bit(i - 1) : 1))? -1 : 1;
+			if(tau >= Q_SPAN)
+				ph += M_PI / 2.0 * a;
+			else {
+				j = (unsigned int)((tau + Q_SPAN) * Q_RES);
+				ph += M_PI / 2.0 * a * m_q[j];
+			}
+		}
+
+		carrier = fmod(w * (double)(index + n), 2.0 * M_PI);
+		out[n] = complex(m_amplitude * cos(ph + carrier) + m_noise * noise(index + n, 0),
+		   m_amplitude * sin(ph + carrier) + m_noise * noise(index + n, 1));
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * gsm_synth
+ *
+ * Deterministic synthetic C0 carrier: FCCH and SCH on timeslot 0 of the
+ * 51-multiframe, pseudo-random bursts everywhere else, GMSK modulated with a
+ * continuous phase, plus a carrier offset and white noise.  The output is a
+ * pure function of the absolute sample index, so any window of the stream
+ * can be generated on its own and regenerated identically.
+ */
+
+#pragma once
+
+#include "usrp_complex.h"
+
+class gsm_synth {
+public:
+	gsm_synth(const float sample_rate, const float offset = 0.0, const float snr = 30.0, const float amplitude = 1000.0, const int bsic = 0, const unsigned int fn = 0, const unsigned int seed = 1);
+	~gsm_synth();
+
+	void generate(complex *out, const unsigned int len, const unsigned long long index);
+	void set_offset(const float offset);
+	void set_amplitude(const float amplitude);
+	void set_carrier(const bool on);
+	void set_bsic(const int bsic);
+	float offset();
+
+	static void sch_bits(const int bsic, const unsigned int fn, unsigned char *bits);
+
+private:
+	unsigned char burst_bit(const unsigned long long symbol);
+	double phase_at(const unsigned long long symbol);
+	float noise(const unsigned long long index, const unsigned int k);
+
+	double		m_sps;		// double: symbol times must hold long runs
+	float		m_sample_rate,
+			m_offset,
+			m_snr,
+			m_amplitude,
+			m_noise;
+	int		m_bsic;
+	bool		m_carrier;
+	unsigned int	m_fn,
+			m_seed;
+
+	// integrated gaussian frequency pulse, Q_RES points per symbol
+	static const unsigned int Q_SPAN = 3;
+	static const unsigned int Q_RES = 64;
+	float		m_q[2 * Q_SPAN * Q_RES + 1];
+
+	// cache of the phase accumulated before a frame boundary
+	unsigned long long m_phase_frame;
+	double		m_phase;
+
+	// SCH bits of the frame in m_sch_frame
+	unsigned long long m_sch_frame;
+	unsigned char	m_sch[148];
+};
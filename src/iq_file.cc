@@ -0,0 +1,750 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+#include "iq_file.h"
+#include "usrp_source.h"
+#include "profile.h"
+
+extern int g_verbosity;
+
+static const char HEADER_MAGIC[4] = { 'K', 'A', 'L', 'Q' };
+static const char BLOCK_MAGIC[4] = { 'K', 'Q', 'B', 'K' };
+static const char INDEX_MAGIC[4] = { 'K', 'Q', 'I', 'X' };
+static const uint32_t FORMAT_VERSION = 1;
+static const int ZSTD_LEVEL = 1;	// as fast as it gets without going negative
+
+enum {
+	BLOCK_EMPTY,
+	BLOCK_BUSY,
+	BLOCK_READY,
+	BLOCK_ERROR
+};
+
+
+static inline unsigned int sample_size(int format) {
+
+	return (format == IQ_SC8)? 2 : 2 * sizeof(short);
+}
+
+
+iq_writer::iq_writer(const char *path, int format, double rate) {
+
+	m_path = strdup(path);
+	m_fp = 0;
+	m_format = format;
+	m_rate = rate;
+	m_buf = 0;
+	m_buf_len = 0;
+	m_raw = 0;
+	m_out = 0;
+	m_out_len = 0;
+	m_first = 0;
+	m_bytes = 0;
+	m_cctx = 0;
+}
+
+
+iq_writer::~iq_writer() {
+
+	if(m_fp)
+		fclose(m_fp);
+#ifdef HAVE_ZSTD
+	if(m_cctx)
+		ZSTD_freeCCtx((ZSTD_CCtx *)m_cctx);
+#endif /* HAVE_ZSTD */
+	delete[] m_out;
+	delete[] m_raw;
+	delete[] m_buf;
+	free(m_path);
+}
+
+
+int iq_writer::open() {
+
+	iq_header h;
+	size_t raw_len = IQ_BLOCK_LEN * sample_size(m_format);
+
+	if(!(m_fp = fopen(m_path, "wb"))) {
+		fprintf(stderr, "error: iq_writer: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, HEADER_MAGIC, sizeof(h.magic));
+	h.version = FORMAT_VERSION;
+	h.format = m_format;
+	h.block_len = IQ_BLOCK_LEN;
+	h.rate = m_rate;
+	if(fwrite(&h, sizeof(h), 1, m_fp) != 1) {
+		fprintf(stderr, "error: iq_writer: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+	m_bytes = sizeof(h);
+
+	m_buf = new complex[IQ_BLOCK_LEN];
+	m_raw = new unsigned char[raw_len];
+	m_out_len = raw_len;
+#ifdef HAVE_ZSTD
+	m_out_len = ZSTD_compressBound(raw_len);
+	m_cctx = ZSTD_createCCtx();
+#endif /* HAVE_ZSTD */
+	m_out = new unsigned char[m_out_len];
+
+	return 0;
+}
+
+
+/*
+ * Adds len samples, writing out every block that fills.
+ */
+int iq_writer::write(const complex *s, unsigned int len) {
+
+	unsigned int n;
+
+	while(len) {
+		n = IQ_BLOCK_LEN - m_buf_len;
+		if(n > len)
+			n = len;
+		memcpy(m_buf + m_buf_len, s, n * sizeof(complex));
+		m_buf_len += n;
+		s += n;
+		len -= n;
+		if((m_buf_len == IQ_BLOCK_LEN) && flush_block())
+			return -1;
+	}
+
+	return 0;
+}
+
+
+static inline int quantize(float x, float scale, int limit) {
+
+	int v = (int)lrintf(x / scale);
+
+	return (v > limit)? limit : ((v < -limit)? -limit : v);
+}
+
+
+int iq_writer::flush_block() {
+
+	unsigned int i, n = m_buf_len;
+	size_t raw_len = n * sample_size(m_format), size = raw_len;
+	float max = 0.0, scale = 1.0;
+	unsigned short v;
+	const unsigned char *payload = m_raw;
+	iq_block_header h;
+	iq_index_entry e;
+	profile_timer pt(PROF_CODEC, n);
+
+	if(!n)
+		return 0;
+
+	for(i = 0; i < n; i++) {
+		if(fabs(m_buf[i].real()) > max)
+			max = fabs(m_buf[i].real());
+		if(fabs(m_buf[i].imag()) > max)
+			max = fabs(m_buf[i].imag());
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BLOCK_MAGIC, sizeof(h.magic));
+	h.samples = n;
+	h.codec = IQ_STORED;
+
+	if(m_format == IQ_SC8) {
+		if(max > 0.0)
+			scale = max / 127.0;
+		for(i = 0; i < n; i++) {
+			m_raw[2 * i] = (unsigned char)quantize(m_buf[i].real(), scale, 127);
+			m_raw[2 * i + 1] = (unsigned char)quantize(m_buf[i].imag(), scale, 127);
+		}
+	} else {
+		// a power of two keeps 16-bit samples exact
+		if(max > 0.0) {
+			scale = ldexpf(1.0, (int)ceil(log2(max / 32767.0)));
+			if(max / scale > 32767.0)
+				scale *= 2.0;
+		}
+		for(i = 0; i < n; i++) {
+			v = (unsigned short)quantize(m_buf[i].real(), scale, 32767);
+			m_raw[2 * i] = v & 0xff;
+			m_raw[2 * n + 2 * i] = v >> 8;
+			v = (unsigned short)quantize(m_buf[i].imag(), scale, 32767);
+			m_raw[2 * i + 1] = v & 0xff;
+			m_raw[2 * n + 2 * i + 1] = v >> 8;
+		}
+	}
+	h.scale = scale;
+
+#ifdef HAVE_ZSTD
+	{
+		size_t r;
+
+		r = ZSTD_compressCCtx((ZSTD_CCtx *)m_cctx, m_out, m_out_len,
+		   m_raw, raw_len, ZSTD_LEVEL);
+		if((!ZSTD_isError(r)) && (r < raw_len)) {
+			h.codec = IQ_ZSTD;
+			size = r;
+			payload = m_out;
+		}
+	}
+#endif /* HAVE_ZSTD */
+	h.size = size;
+
+	e.offset = m_bytes;
+	e.first = m_first;
+	if((fwrite(&h, sizeof(h), 1, m_fp) != 1) ||
+	   (fwrite(payload, 1, size, m_fp) != size)) {
+		fprintf(stderr, "error: iq_writer: %s: %s\n", m_path,
+		   strerror(errno));
+		return -1;
+	}
+	m_index.push_back(e);
+	m_bytes += sizeof(h) + size;
+	m_first += n;
+	m_buf_len = 0;
+
+	return 0;
+}
+
+
+/*
+ * Writes out the last block and the index.
+ */
+int iq_writer::close() {
+
+	iq_trailer t;
+	int r = 0;
+
+	if(!m_fp)
+		return -1;
+	if(flush_block())
+		r = -1;
+
+	memset(&t, 0, sizeof(t));
+	memcpy(t.magic, INDEX_MAGIC, sizeof(t.magic));
+	t.count = m_index.size();
+	t.offset = m_bytes;
+	if((!r) && ((m_index.size() && (fwrite(&m_index[0],
+	   sizeof(iq_index_entry), m_index.size(), m_fp) != m_index.size())) ||
+	   (fwrite(&t, sizeof(t), 1, m_fp) != 1))) {
+		fprintf(stderr, "error: iq_writer: %s: %s\n", m_path,
+		   strerror(errno));
+		r = -1;
+	}
+	m_bytes += m_index.size() * sizeof(iq_index_entry) + sizeof(t);
+
+	if(fclose(m_fp) && (!r)) {
+		fprintf(stderr, "error: iq_writer: %s: %s\n", m_path,
+		   strerror(errno));
+		r = -1;
+	}
+	m_fp = 0;
+
+	return r;
+}
+
+
+unsigned long long iq_writer::bytes() {
+
+	return m_bytes;
+}
+
+
+iq_reader::iq_reader() {
+
+	m_map = 0;
+	m_map_len = 0;
+	m_header = 0;
+	m_count = 0;
+	m_want = 0;
+	m_quit = 0;
+	m_scratch = 0;
+	m_dctx = 0;
+	pthread_mutex_init(&m_mutex, 0);
+	pthread_cond_init(&m_cond, 0);
+}
+
+
+iq_reader::~iq_reader() {
+
+	stop();
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_mutex);
+}
+
+
+/*
+ * Reads the header and index of a recording mapped at map.  An index that
+ * doesn't describe the blocks in front of it is ignored and the blocks
+ * are walked instead.  Returns -1 if it isn't a recording.
+ */
+int iq_reader::open(const void *map, size_t len) {
+
+	iq_trailer t;
+	iq_block_header h;
+	unsigned int i;
+	uint64_t pos, first;
+
+	m_map = (const unsigned char *)map;
+	m_map_len = len;
+	m_header = (const iq_header *)map;
+	m_index.clear();
+
+	if((len < sizeof(iq_header)) ||
+	   memcmp(m_header->magic, HEADER_MAGIC, sizeof(HEADER_MAGIC)) ||
+	   (m_header->version != FORMAT_VERSION) ||
+	   ((m_header->format != IQ_SC16) && (m_header->format != IQ_SC8)) ||
+	   (!m_header->block_len) || (m_header->block_len > IQ_BLOCK_LEN) ||
+	   (m_header->rate <= 0.0)) {
+		fprintf(stderr, "error: iq_reader: not a recording\n");
+		return -1;
+	}
+
+	if(len >= sizeof(iq_header) + sizeof(t))
+		memcpy(&t, m_map + len - sizeof(t), sizeof(t));
+	if((len >= sizeof(iq_header) + sizeof(t)) &&
+	   (!memcmp(t.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC))) &&
+	   (t.offset + (uint64_t)t.count * sizeof(iq_index_entry) + sizeof(t) == len)) {
+		m_index.resize(t.count);
+		if(t.count) {
+			memcpy(&m_index[0], m_map + t.offset,
+			   t.count * sizeof(iq_index_entry));
+		}
+
+		// the blocks in order, each starting where the last ended
+		pos = sizeof(iq_header);
+		first = 0;
+		for(i = 0; i < t.count; i++) {
+			if((m_index[i].offset != pos) ||
+			   (m_index[i].first != first) ||
+			   (pos + sizeof(h) > t.offset))
+				break;
+			memcpy(&h, m_map + pos, sizeof(h));
+			if(memcmp(h.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) ||
+			   (pos + sizeof(h) + h.size > t.offset))
+				break;
+			pos += sizeof(h) + h.size;
+			first += h.samples;
+		}
+		if((i < t.count) || (pos != t.offset)) {
+			fprintf(stderr, "warning: iq_reader: bad index, "
+			   "walking the blocks\n");
+			m_index.clear();
+		}
+	}
+
+	if(m_index.empty() && walk())
+		return -1;
+	if(m_index.empty()) {
+		fprintf(stderr, "error: iq_reader: no samples\n");
+		return -1;
+	}
+
+	memcpy(&h, m_map + m_index.back().offset, sizeof(h));
+	m_count = m_index.back().first + h.samples;
+
+	if(g_verbosity > 1) {
+		fprintf(stderr, "iq_reader: %u blocks, %llu samples\n",
+		   (unsigned int)m_index.size(), m_count);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Indexes a recording without one by following the block headers up to
+ * the first that is cut short.
+ */
+int iq_reader::walk() {
+
+	iq_block_header h;
+	iq_index_entry e;
+	size_t pos = sizeof(iq_header);
+
+	e.first = 0;
+	while(pos + sizeof(h) <= m_map_len) {
+		memcpy(&h, m_map + pos, sizeof(h));
+		if(memcmp(h.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) ||
+		   (pos + sizeof(h) + h.size > m_map_len))
+			break;
+		e.offset = pos;
+		m_index.push_back(e);
+		e.first += h.samples;
+		pos += sizeof(h) + h.size;
+	}
+
+	if(g_verbosity > 0) {
+		fprintf(stderr, "iq_reader: no index, %u blocks found\n",
+		   (unsigned int)m_index.size());
+	}
+
+	return 0;
+}
+
+
+/*
+ * Decodes block k into b, using scratch for the compressed stage.
+ */
+int iq_reader::decode(unsigned int k, iq_block *b, unsigned char *scratch,
+   void *dctx) {
+
+	iq_block_header h;
+	const unsigned char *src;
+	unsigned short *d;
+	size_t raw_len;
+	unsigned int i, n;
+
+	memcpy(&h, m_map + m_index[k].offset, sizeof(h));
+	if(memcmp(h.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) ||
+	   (h.samples > m_header->block_len) ||
+	   (m_index[k].offset + sizeof(h) + h.size > m_map_len)) {
+		fprintf(stderr, "error: iq_reader: block %u: bad header\n", k);
+		return -1;
+	}
+	profile_timer pt(PROF_CODEC, h.samples);
+
+	src = m_map + m_index[k].offset + sizeof(h);
+	raw_len = h.samples * sample_size(m_header->format);
+	if(h.codec == IQ_ZSTD) {
+#ifdef HAVE_ZSTD
+		size_t r;
+
+		r = ZSTD_decompressDCtx((ZSTD_DCtx *)dctx, scratch, raw_len,
+		   src, h.size);
+		if(ZSTD_isError(r) || (r != raw_len)) {
+			fprintf(stderr, "error: iq_reader: block %u: %s\n", k,
+			   ZSTD_isError(r)? ZSTD_getErrorName(r) : "short");
+			return -1;
+		}
+		src = scratch;
+#else
+		fprintf(stderr, "error: iq_reader: built without zstd\n");
+		return -1;
+#endif /* HAVE_ZSTD */
+	} else if((h.codec != IQ_STORED) || (h.size != raw_len)) {
+		fprintf(stderr, "error: iq_reader: block %u: bad block\n", k);
+		return -1;
+	}
+
+	if(m_header->format == IQ_SC8)
+		memcpy(b->data, src, raw_len);
+	else {
+		d = (unsigned short *)b->data;
+		n = 2 * h.samples;
+		for(i = 0; i < n; i++)
+			d[i] = src[i] | (src[n + i] << 8);
+	}
+	b->samples = h.samples;
+	b->scale = h.scale;
+
+	return 0;
+}
+
+
+void *iq_reader::worker(void *arg) {
+
+	iq_reader *r = (iq_reader *)arg;
+	unsigned int k, end, w = r->m_blocks.size();
+	unsigned char *scratch = new unsigned char[r->m_header->block_len *
+	   sample_size(r->m_header->format)];
+	void *dctx = 0;
+	iq_block *b = 0;
+	int e;
+
+#ifdef HAVE_ZSTD
+	dctx = ZSTD_createDCtx();
+#endif /* HAVE_ZSTD */
+
+	pthread_mutex_lock(&r->m_mutex);
+	while(!r->m_quit) {
+		// the first block of the window nobody has taken
+		end = r->m_want + w;
+		if(end > r->m_index.size())
+			end = r->m_index.size();
+		for(k = r->m_want; k < end; k++) {
+			b = &r->m_blocks[k % w];
+			if((b->k != k) && (b->state != BLOCK_BUSY))
+				break;
+		}
+		if(k >= end) {
+			pthread_cond_wait(&r->m_cond, &r->m_mutex);
+			continue;
+		}
+
+		b->k = k;
+		b->state = BLOCK_BUSY;
+		pthread_mutex_unlock(&r->m_mutex);
+		e = r->decode(k, b, scratch, dctx);
+		pthread_mutex_lock(&r->m_mutex);
+		b->state = e? BLOCK_ERROR : BLOCK_READY;
+		pthread_cond_broadcast(&r->m_cond);
+	}
+	pthread_mutex_unlock(&r->m_mutex);
+
+#ifdef HAVE_ZSTD
+	ZSTD_freeDCtx((ZSTD_DCtx *)dctx);
+#endif /* HAVE_ZSTD */
+	delete[] scratch;
+
+	return 0;
+}
+
+
+/*
+ * Starts workers threads decoding ahead of the caller.  With none each
+ * block is decoded when it is asked for.
+ */
+int iq_reader::start(unsigned int workers) {
+
+	unsigned int i;
+	size_t raw_len = m_header->block_len * sample_size(m_header->format);
+	pthread_t tid;
+	int r;
+
+	// each worker has a block in hand, and the caller has one
+	m_blocks.resize(workers + 2);
+	for(i = 0; i < m_blocks.size(); i++) {
+		m_blocks[i].data = new unsigned char[raw_len];
+		m_blocks[i].k = ~0U;
+		m_blocks[i].state = BLOCK_EMPTY;
+	}
+	m_want = 0;
+	m_quit = 0;
+
+	if(!workers) {
+		m_scratch = new unsigned char[raw_len];
+#ifdef HAVE_ZSTD
+		m_dctx = ZSTD_createDCtx();
+#endif /* HAVE_ZSTD */
+	}
+	for(i = 0; i < workers; i++) {
+		if((r = pthread_create(&tid, 0, worker, this))) {
+			fprintf(stderr, "error: iq_reader: pthread_create: %s\n",
+			   strerror(r));
+			stop();
+			return -1;
+		}
+		m_workers.push_back(tid);
+	}
+
+	return 0;
+}
+
+
+void iq_reader::stop() {
+
+	unsigned int i;
+
+	pthread_mutex_lock(&m_mutex);
+	m_quit = 1;
+	pthread_cond_broadcast(&m_cond);
+	pthread_mutex_unlock(&m_mutex);
+	for(i = 0; i < m_workers.size(); i++)
+		pthread_join(m_workers[i], 0);
+	m_workers.clear();
+
+	for(i = 0; i < m_blocks.size(); i++)
+		delete[] (unsigned char *)m_blocks[i].data;
+	m_blocks.clear();
+	delete[] m_scratch;
+	m_scratch = 0;
+#ifdef HAVE_ZSTD
+	if(m_dctx)
+		ZSTD_freeDCtx((ZSTD_DCtx *)m_dctx);
+#endif /* HAVE_ZSTD */
+	m_dctx = 0;
+}
+
+
+/*
+ * Block k, waiting for it to be decoded.  It stays valid until the next
+ * call, which lets the workers have it back.  Returns 0 if it couldn't be
+ * decoded.
+ */
+const iq_block *iq_reader::get(unsigned int k) {
+
+	iq_block *b;
+	int state;
+
+	if((k >= m_index.size()) || m_blocks.empty())
+		return 0;
+
+	pthread_mutex_lock(&m_mutex);
+	m_want = k;
+	b = &m_blocks[k % m_blocks.size()];
+	if(m_workers.empty()) {
+		if(b->k != k) {
+			b->k = k;
+			b->state = decode(k, b, m_scratch, m_dctx)? BLOCK_ERROR :
+			   BLOCK_READY;
+		}
+	} else {
+		pthread_cond_broadcast(&m_cond);
+		while((b->k != k) || ((b->state != BLOCK_READY) &&
+		   (b->state != BLOCK_ERROR)))
+			pthread_cond_wait(&m_cond, &m_mutex);
+	}
+	state = b->state;
+	pthread_mutex_unlock(&m_mutex);
+
+	return (state == BLOCK_READY)? b : 0;
+}
+
+
+/*
+ * Converts len samples of b, starting with sample first, to complex.
+ */
+void iq_reader::convert(const iq_block *b, unsigned int first, complex *c,
+   unsigned int len) {
+
+	const signed char *s8 = (const signed char *)b->data + 2 * first;
+	unsigned int i;
+
+	if(m_header->format == IQ_SC8) {
+		for(i = 0; i < len; i++)
+			c[i] = complex(s8[2 * i] * b->scale, s8[2 * i + 1] * b->scale);
+		return;
+	}
+
+	sc16_to_fc32((const short *)b->data + 2 * first, c, len);
+	if(b->scale != 1.0) {
+		for(i = 0; i < len; i++)
+			c[i] *= b->scale;
+	}
+}
+
+
+int iq_reader::format() {
+
+	return m_header->format;
+}
+
+
+double iq_reader::rate() {
+
+	return m_header->rate;
+}
+
+
+unsigned int iq_reader::block_count() {
+
+	return m_index.size();
+}
+
+
+/*
+ * The block holding sample pos, and in first the sample it starts with.
+ */
+unsigned int iq_reader::block_of(unsigned long long pos, unsigned long long *first) {
+
+	unsigned int lo = 0, hi = m_index.size(), mid;
+
+	while(hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if(m_index[mid].first <= pos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if(first)
+		*first = m_index[lo].first;
+
+	return lo;
+}
+
+
+unsigned long long iq_reader::sample_count() {
+
+	return m_count;
+}
+
+
+/*
+ * Records seconds of the stream from u, which must be tuned, to path.
+ * Returns -1 if the device or the disk fails.
+ */
+int iq_record(usrp_source *u, const char *path, int format, double seconds) {
+
+	unsigned long long total, done = 0;
+	unsigned int len, overruns = 0, n;
+	circular_buffer *cb = u->get_buffer();
+	complex *c;
+	iq_writer w(path, format, u->sample_rate());
+	int r = 0;
+
+	total = (unsigned long long)(seconds * u->sample_rate());
+	if(w.open())
+		return -1;
+
+	u->start();
+	u->flush();
+	while(done < total) {
+		if(u->fill(IQ_BLOCK_LEN / 4, &n)) {
+			r = -1;
+			break;
+		}
+		overruns += n;
+		c = (complex *)cb->peek(&len);
+		if(len > total - done)
+			len = total - done;
+		if(w.write(c, len)) {
+			r = -1;
+			break;
+		}
+		cb->purge(len);
+		done += len;
+	}
+	u->stop();
+	if(w.close())
+		r = -1;
+
+	fprintf(stderr, "Recorded %llu samples (%.1fs) to %s: %llu bytes, "
+	   "%.2f per sample\n", done, done / u->sample_rate(), path, w.bytes(),
+	   done? (double)w.bytes() / done : 0.0);
+	if(overruns)
+		fprintf(stderr, "warning: %u overruns, the recording has gaps\n",
+		   overruns);
+
+	return r;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * iq_file
+ *
+ * Compact recordings.  Samples are stored as interleaved 8 or 16-bit I/Q
+ * in blocks of up to IQ_BLOCK_LEN samples, each with its own scale, and each
+ * block is compressed with zstd where kal was built with it.  16-bit
+ * blocks have the low and high bytes of every value gathered separately
+ * first, which gives zstd runs to work with.  16-bit scales are powers of
+ * two, so samples from a device that delivers 16-bit values are kept
+ * exactly; 8-bit scales make the most of the range.  That only holds for
+ * what the device delivered, so kal records before any resampling and
+ * -r is applied when the recording is replayed.
+ *
+ * The file is a header, the blocks, then an index of where every block
+ * starts so a reader can seek without walking them:
+ *
+ *	iq_header
+ *	iq_block_header, payload	repeated
+ *	iq_index_entry			one per block
+ *	iq_trailer
+ *
+ * all in host byte order.  A recording that was cut short has no index and
+ * is read by walking the block headers instead.
+ *
+ * iq_writer streams blocks to disk as samples are added.  iq_reader works
+ * on a recording mapped into memory and decodes ahead of the caller with
+ * worker threads, one block each, handing the blocks back in order.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <vector>
+
+#include "usrp_complex.h"
+
+class usrp_source;
+
+static const unsigned int IQ_BLOCK_LEN = 1 << 16;
+
+enum {
+	IQ_SC16,
+	IQ_SC8
+};
+
+enum {
+	IQ_STORED,
+	IQ_ZSTD
+};
+
+struct iq_header {
+	char		magic[4];	// "KALQ"
+	uint32_t	version,
+			format,
+			block_len;
+	double		rate;
+};
+
+struct iq_block_header {
+	char		magic[4];	// "KQBK"
+	uint32_t	samples,
+			size,		// of the payload
+			codec;
+	float		scale;
+	uint32_t	reserved;
+};
+
+struct iq_index_entry {
+	uint64_t	offset,		// of the block header in the file
+			first;		// sample
+};
+
+struct iq_trailer {
+	char		magic[4];	// "KQIX"
+	uint32_t	count;
+	uint64_t	offset;		// of the index
+};
+
+/*
+ * A decoded block: the samples as stored, to be multiplied by scale.
+ */
+struct iq_block {
+	unsigned int	samples;
+	float		scale;
+	void *		data;
+
+	// where it is in the reader's window
+	unsigned int	k;
+	int		state;
+};
+
+class iq_writer {
+public:
+	iq_writer(const char *path, int format, double rate);
+	~iq_writer();
+
+	int open();
+	int write(const complex *s, unsigned int len);
+	int close();
+	unsigned long long bytes();
+
+private:
+	int flush_block();
+
+	char *				m_path;
+	FILE *				m_fp;
+	int				m_format;
+	double				m_rate;
+	complex *			m_buf;
+	unsigned int			m_buf_len;
+	unsigned char *			m_raw,
+					*m_out;
+	size_t				m_out_len;
+	unsigned long long		m_first,
+					m_bytes;
+	std::vector<iq_index_entry>	m_index;
+	void *				m_cctx;
+};
+
+class iq_reader {
+public:
+	iq_reader();
+	~iq_reader();
+
+	int open(const void *map, size_t len);
+	int start(unsigned int workers);
+	void stop();
+	const iq_block *get(unsigned int k);
+	void convert(const iq_block *b, unsigned int first, complex *c,
+	   unsigned int len);
+
+	int format();
+	double rate();
+	unsigned int block_count();
+	unsigned int block_of(unsigned long long pos, unsigned long long *first);
+	unsigned long long sample_count();
+
+private:
+	int walk();
+	int decode(unsigned int k, iq_block *b, unsigned char *scratch, void *dctx);
+	static void *worker(void *arg);
+
+	const unsigned char *		m_map;
+	size_t				m_map_len;
+	const iq_header *		m_header;
+	std::vector<iq_index_entry>	m_index;
+	unsigned long long		m_count;
+
+	/*
+	 * Block k is decoded into m_blocks[k % m_blocks.size()] as soon as
+	 * the caller has moved past the block that was there.  m_want is the
+	 * block the caller is on.
+	 */
+	std::vector<iq_block>		m_blocks;
+	std::vector<pthread_t>		m_workers;
+	pthread_mutex_t			m_mutex;
+	pthread_cond_t			m_cond;
+	unsigned int			m_want;
+	int				m_quit;
+	unsigned char *			m_scratch;	// when there are no workers
+	void *				m_dctx;
+};
+
+int iq_record(usrp_source *u, const char *path, int format, double seconds);
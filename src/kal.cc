@@ -53,17 +53,30 @@
 #include <errno.h>
 
 #include "usrp_source.h"
+#include "sim_source.h"
+#include "file_source.h"
+#include "udp_source.h"
 #include "fcch_detector.h"
 #include "arfcn_freq.h"
 #include "offset.h"
+#include "burst_archive.h"
+#include "iq_file.h"
 #include "c0_detect.h"
+#include "c0_cache.h"
+#include "batch.h"
+#include "server.h"
+#include "profile.h"
+#include "rt.h"
+#include "gain.h"
 #include "version.h"
+#include "util.h"
 
-static const double GSM_RATE = 1625000.0 / 6.0;
+static const int DEVICES_MAX = 8;
 
 
 int g_verbosity = 0;
 int g_debug = 0;
+int g_profile = 0;
 
 void usage(char *prog) {
 
@@ -76,15 +89,47 @@ void usage(char *prog) {
 	printf("\t\t%s <-f frequency | -c channel> [options]\n", basename(prog));
 	printf("\n");
 	printf("Where options are:\n");
-	printf("\t-s\tband to scan (GSM850, GSM900, EGSM, DCS, PCS)\n");
+	printf("\t-s\tbands to scan (GSM850, GSM900, EGSM, DCS, PCS, comma\n");
+	printf("\t\tseparated, or all)\n");
+	printf("\t-C\twith -s, only scan these channels, e.g. 512-540,600\n");
+	printf("\t-N\twith -s, channels to take the noise floor from\n");
 	printf("\t-f\tfrequency of nearby GSM base station\n");
-	printf("\t-c\tchannel of nearby GSM base station\n");
+	printf("\t-c\tchannel of nearby GSM base station, or with several -u,\n");
+	printf("\t\tone for each device in order, e.g. 20,50\n");
 	printf("\t-b\tband indicator (GSM850, GSM900, EGSM, DCS, PCS)\n");
 	printf("\t-R\tside A (0) or B (1), defaults to B\n");
 	printf("\t-A\tantenna TX/RX (0) or RX2 (1), defaults to RX2\n");
-	printf("\t-g\tgain as %% of range, defaults to 45%%\n");
+	printf("\t-g\tgain as %% of range, or auto, defaults to 45%%\n");
 	printf("\t-F\tFPGA master clock frequency, defaults to 52MHz\n");
 	printf("\t-x\tenable external 10MHz reference input\n");
+	printf("\t-u\tdevice arguments, defaults to type=usrp2 (\"sim\" to simulate,\n");
+	printf("\t\t\"file=<path>\" to replay a recording, \"udp=[addr:]port\"\n");
+	printf("\t\tto receive from the network), repeat for more devices\n");
+	printf("\t-r\tresample to this many samples per symbol\n");
+	printf("\t-K\tscan cache file, known carriers are checked first\n");
+	printf("\t-S\twith -K, sweep the bands again\n");
+	printf("\t-M\tmonitor clock drift continuously\n");
+	printf("\t-W\tappend the bursts each offset is measured from to this\n");
+	printf("\t\tarchive\n");
+	printf("\t-Y\tmeasure the bursts in this archive again\n");
+	printf("\t-O\trecord the channel to this file, for -u file=\n");
+	printf("\t-L\twith -O, seconds to record, defaults to 10\n");
+	printf("\t-z\twith -O, record 8-bit samples instead of 16-bit\n");
+	printf("\t-t\ttrack FCCH bursts using the SCH frame number\n");
+	printf("\t-w\tlike -t, but only capture the predicted bursts\n");
+	printf("\t-e\tstop once offset is known to +/- this many Hz\n");
+	printf("\t-k\tconfidence for -e as %%, defaults to 95%%\n");
+	printf("\t-n\tcombine this many FCCH bursts per offset (2-%u)\n",
+	   BURSTS_MAX);
+	printf("\t-P\tprint time spent in each stage at exit\n");
+	printf("\t-T\tformat for -P, human (default) or json\n");
+	printf("\t-a\trun on these CPUs, e.g. 2,3 or 1-3\n");
+	printf("\t-q\trun with this SCHED_FIFO priority (1-99)\n");
+	printf("\t-l\tlock and prefault memory\n");
+	printf("\t-B\tanalyze the recordings in this directory or list\n");
+	printf("\t-o\twith -B, write results here (.json for JSON lines)\n");
+	printf("\t-j\twith -B, number of threads, defaults to one per CPU\n");
+	printf("\t-d\tserve requests on this Unix domain socket\n");
 	printf("\t-v\tverbose\n");
 	printf("\t-D\tenable debug messages\n");
 	printf("\t-h\thelp\n");
@@ -94,31 +139,55 @@ void usage(char *prog) {
 
 int main(int argc, char **argv) {
 
-	char *endptr;
-	int c, antenna = 1, bi = BI_NOT_DEFINED, chan = -1, bts_scan = 0;
-	unsigned int subdev = 1;
+	char *endptr, *p, only[ARFCN_COUNT], ref[ARFCN_COUNT];
+	int c, antenna = 1, bi = BI_NOT_DEFINED, chan = -1, bts_scan = 0, monitor = 0, track = 0,
+	   window = 0, bands[BI_COUNT], band_count = 0, i, b,
+	   dev_chan[DEVICES_MAX], dev_bi[DEVICES_MAX], device_count = 0,
+	   chan_count = 0;
+	unsigned int subdev = 1, sps = 0, threads = 0, bursts = 1;
 	long int fpga_master_clock_freq = 100000000;
 	bool external_ref = false;
-	float gain = 0.45;
-	double freq = -1.0, fd;
-	usrp_source *u;
-
-	while((c = getopt(argc, argv, "f:c:s:b:R:A:g:F:xvDh?")) != EOF) {
+	const char *dev_args = "type=usrp2", *cache_file = 0, *cpus = 0,
+	   *batch = 0, *batch_out = 0, *server_path = 0, *devices[DEVICES_MAX],
+	   *archive_path = 0, *replay = 0, *record_path = 0;
+	float gain = 0.45, g, precision = 0.0, confidence = 0.95;
+	double freq = -1.0, fd, dev_freq[DEVICES_MAX], record_len = 10.0;
+	usrp_source *u, *us[DEVICES_MAX];
+	c0_cache *cache = 0;
+	burst_archive *archive = 0;
+	int sweep = 0, r, profile_format = PROF_HUMAN, rt_prio = 0, lock = 0,
+	   agc = 0, have_only = 0, have_ref = 0, record_format = IQ_SC16;
+
+	while((c = getopt(argc, argv, "f:c:s:b:R:A:g:F:xu:r:K:SC:N:MW:Y:O:L:ztwe:k:n:PT:a:q:lB:o:j:d:vDh?")) != EOF) {
 		switch(c) {
 			case 'f':
 				freq = strtod(optarg, 0);
 				break;
 
 			case 'c':
-				chan = strtoul(optarg, 0, 0);
+				for(chan_count = 0, p = optarg; ; p = endptr + 1) {
+					i = strtol(p, &endptr, 0);
+					if((endptr == p) || (i < 0) ||
+					   (chan_count == DEVICES_MAX) ||
+					   (*endptr && (*endptr != ','))) {
+						fprintf(stderr, "error: bad channel: "
+						   "``%s''\n", optarg);
+						usage(argv[0]);
+					}
+					dev_chan[chan_count++] = i;
+					if(!*endptr)
+						break;
+				}
+				chan = dev_chan[0];
 				break;
 
 			case 's':
-				if((bi = str_to_bi(optarg)) == -1) {
+				if((band_count = str_to_bi_list(optarg, bands, BI_COUNT)) == -1) {
 					fprintf(stderr, "error: bad band "
 					   "indicator: ``%s''\n", optarg);
 					usage(argv[0]);
 				}
+				bi = bands[0];
 				bts_scan = 1;
 				break;
 
@@ -165,6 +234,10 @@ int main(int argc, char **argv) {
 				break;
 
 			case 'g':
+				if(!strcmp(optarg, "auto")) {
+					agc = 1;
+					break;
+				}
 				gain = strtod(optarg, 0);
 				if((gain > 1.0) && (gain <= 100.0))
 					gain /= 100.0;
@@ -187,6 +260,165 @@ int main(int argc, char **argv) {
 				external_ref = true;
 				break;
 
+			case 'u':
+				if(device_count == DEVICES_MAX) {
+					fprintf(stderr, "error: at most %d devices\n",
+					   DEVICES_MAX);
+					usage(argv[0]);
+				}
+				devices[device_count++] = optarg;
+				break;
+
+			case 'r':
+				sps = strtoul(optarg, &endptr, 0);
+				if((!sps) || (sps > 16) || (endptr == optarg)) {
+					fprintf(stderr, "error: bad samples per "
+					   "symbol: ``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+
+			case 'K':
+				cache_file = optarg;
+				break;
+
+			case 'C':
+			case 'N':
+				if(str_to_arfcn_set(optarg, (c == 'C')? only :
+				   ref) < 0) {
+					fprintf(stderr, "error: bad channel list: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				if(c == 'C')
+					have_only = 1;
+				else
+					have_ref = 1;
+				break;
+
+			case 'S':
+				sweep = 1;
+				break;
+
+			case 'M':
+				monitor = 1;
+				break;
+
+			case 'W':
+				archive_path = optarg;
+				break;
+
+			case 'Y':
+				replay = optarg;
+				break;
+
+			case 'O':
+				record_path = optarg;
+				break;
+
+			case 'L':
+				record_len = strtod(optarg, &endptr);
+				if((*endptr) || (record_len <= 0.0)) {
+					fprintf(stderr, "error: bad length: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+
+			case 'z':
+				record_format = IQ_SC8;
+				break;
+
+			case 't':
+				track = 1;
+				break;
+
+			case 'w':
+				window = 1;
+				break;
+
+			case 'e':
+				precision = strtod(optarg, 0);
+				if(precision <= 0.0) {
+					fprintf(stderr, "error: bad precision: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+
+			case 'k':
+				confidence = strtod(optarg, 0);
+				if((confidence >= 1.0) && (confidence < 100.0))
+					confidence /= 100.0;
+				if((confidence <= 0.0) || (1.0 <= confidence))
+					usage(argv[0]);
+				break;
+
+			case 'n':
+				bursts = strtoul(optarg, &endptr, 0);
+				if((*endptr) || (bursts < 2) ||
+				   (BURSTS_MAX < bursts)) {
+					fprintf(stderr, "error: bad burst count: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+
+			case 'P':
+				g_profile = 1;
+				break;
+
+			case 'T':
+				if(!strcmp(optarg, "human"))
+					profile_format = PROF_HUMAN;
+				else if(!strcmp(optarg, "json"))
+					profile_format = PROF_JSON;
+				else {
+					fprintf(stderr, "error: bad profile format: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				g_profile = 1;
+				break;
+
+			case 'a':
+				cpus = optarg;
+				break;
+
+			case 'q':
+				rt_prio = strtol(optarg, &endptr, 0);
+				if((*endptr) || (rt_prio < 1) || (99 < rt_prio)) {
+					fprintf(stderr, "error: bad priority: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+
+			case 'l':
+				lock = 1;
+				break;
+
+			case 'B':
+				batch = optarg;
+				break;
+
+			case 'o':
+				batch_out = optarg;
+				break;
+
+			case 'd':
+				server_path = optarg;
+				break;
+
+			case 'j':
+				threads = strtoul(optarg, &endptr, 0);
+				if((*endptr) || (!threads)) {
+					fprintf(stderr, "error: bad thread count: "
+					   "``%s''\n", optarg);
+					usage(argv[0]);
+				}
+				break;
+
 			case 'v':
 				g_verbosity++;
 				break;
@@ -204,12 +436,47 @@ int main(int argc, char **argv) {
 
 	}
 
+	// nothing to tune, the archive has it all
+	if(replay)
+		return offset_replay(replay);
+
+	if(!device_count)
+		devices[device_count++] = dev_args;
+	dev_args = devices[0];
+	if((device_count > 1) && (batch || server_path || monitor)) {
+		fprintf(stderr, "error: several devices only apply to a scan or "
+		   "offset measurement\n");
+		usage(argv[0]);
+	}
+
 	// sanity check frequency / channel
-	if(bts_scan) {
+	if(batch || server_path) {
+		if(bts_scan || monitor || (freq >= 0.0) || (chan >= 0)) {
+			fprintf(stderr, "error: with %s channels and bands "
+			   "are given per request\n", batch? "-B" : "-d");
+			usage(argv[0]);
+		}
+	} else if(bts_scan) {
 		if(bi == BI_NOT_DEFINED) {
 			fprintf(stderr, "error: scaning requires band\n");
 			usage(argv[0]);
 		}
+	} else if(chan_count > 1) {
+		// one channel per device, in order
+		if((chan_count != device_count) || (freq >= 0.0)) {
+			fprintf(stderr, "error: -c gives one channel, or one "
+			   "per device\n");
+			usage(argv[0]);
+		}
+		for(i = 0; i < chan_count; i++) {
+			b = bi;
+			if((dev_freq[i] = arfcn_to_freq(dev_chan[i], &b)) < 869e6) {
+				fprintf(stderr, "error: bad channel: %d\n",
+				   dev_chan[i]);
+				usage(argv[0]);
+			}
+			dev_bi[i] = b;
+		}
 	} else {
 		if(freq < 0.0) {
 			if(chan < 0) {
@@ -225,6 +492,45 @@ int main(int argc, char **argv) {
 			usage(argv[0]);
 		}
 		chan = freq_to_arfcn(freq, &bi);
+		for(i = 0; i < device_count; i++) {
+			dev_chan[i] = chan;
+			dev_bi[i] = bi;
+			dev_freq[i] = freq;
+		}
+	}
+
+	if((have_ref || have_only) && (!bts_scan)) {
+		fprintf(stderr, "error: -C and -N only apply to a scan (-s)\n");
+		usage(argv[0]);
+	}
+
+	if(g_profile && (device_count > 1)) {
+		fprintf(stderr, "error: -P profiles one thread, and can't be used "
+		   "with several devices\n");
+		usage(argv[0]);
+	}
+
+	if(record_path && (bts_scan || batch || server_path || monitor ||
+	   archive_path || (device_count > 1))) {
+		fprintf(stderr, "error: -O records one channel of one device\n");
+		usage(argv[0]);
+	}
+
+	if(archive_path && (bts_scan || batch || server_path)) {
+		fprintf(stderr, "error: -W only applies to offset measurement\n");
+		usage(argv[0]);
+	}
+
+	if(agc && batch) {
+		fprintf(stderr, "error: -g auto can't be used with -B, "
+		   "recordings have no gain to range\n");
+		usage(argv[0]);
+	}
+
+	if((bursts > 1) && (track || window || monitor || bts_scan || batch)) {
+		fprintf(stderr, "error: -n only applies to offset measurement "
+		   "without -t, -w or -M\n");
+		usage(argv[0]);
 	}
 
 	// sanity check clock
@@ -242,40 +548,146 @@ int main(int argc, char **argv) {
 		printf("debug: RX Subdev Spec        :\t%s\n", subdev? "B" : "A");
 		printf("debug: Antenna               :\t%s\n", antenna? "RX2" : "TX/RX");
 		printf("debug: Gain                  :\t%f\n", gain);
+		printf("debug: Device                :\t%s\n", dev_args);
+		printf("debug: Resample              :\t%u sps\n", sps);
+	}
+
+	// before the device is opened so its threads inherit the settings
+	if(cpus && (rt_affinity(cpus) == -1))
+		usage(argv[0]);
+	if(rt_prio)
+		rt_priority(rt_prio);
+	if(lock)
+		rt_lock();
+
+	if(batch) {
+		if(g_profile && (threads != 1)) {
+			fprintf(stderr, "warning: -P profiles one thread, using "
+			   "-j 1\n");
+			threads = 1;
+		}
+		if(g_profile)
+			profile_start();
+		r = batch_run(batch, dev_args, GSM_RATE * (sps? sps : 1),
+		   sps? GSM_RATE * sps : 0.0, batch_out, threads);
+		if(g_profile)
+			profile_report(stderr, profile_format);
+		return r;
 	}
 
-	// let the device decide on the decimation
-	u = new usrp_source(GSM_RATE, fpga_master_clock_freq, external_ref);
-	if(!u) {
-		fprintf(stderr, "error: usrp_source\n");
-		return -1;
+	for(i = 0; i < device_count; i++) {
+		// let the device decide on the decimation
+		if(!strncmp(devices[i], "sim", 3))
+			u = new sim_source(GSM_RATE * (sps? sps : 1), devices[i]);
+		else if(!strncmp(devices[i], "file=", 5))
+			u = new file_source(GSM_RATE * (sps? sps : 1), devices[i]);
+		else if(!strncmp(devices[i], "udp=", 4))
+			u = new udp_source(GSM_RATE * (sps? sps : 1), devices[i]);
+		else
+			u = new usrp_source(GSM_RATE * (sps? sps : 1), fpga_master_clock_freq, external_ref, devices[i]);
+		if(!u) {
+			fprintf(stderr, "error: usrp_source\n");
+			return -1;
+		}
+		// recordings keep the device samples, -r applies on replay
+		if(sps && (!record_path))
+			u->set_output_rate(GSM_RATE * sps);
+		if(u->open(subdev) == -1) {
+			fprintf(stderr, "error: usrp_source::open\n");
+			return -1;
+		}
+		u->set_antenna(antenna);
+		if(!u->set_gain(gain)) {
+			fprintf(stderr, "error: usrp_source::set_gain\n");
+			return -1;
+		}
+		if(agc && (!u->has_gain())) {
+			fprintf(stderr, "error: -g auto needs a device with "
+			   "a gain to set\n");
+			return -1;
+		}
+		us[i] = u;
 	}
-	if(u->open(subdev) == -1) {
-		fprintf(stderr, "error: usrp_source::open\n");
-		return -1;
+	u = us[0];
+
+	if(cache_file && (bts_scan || server_path)) {
+		cache = new c0_cache(cache_file);
+		if(cache->load())
+			return -1;
 	}
-	u->set_antenna(antenna);
-	if(!u->set_gain(gain)) {
-		fprintf(stderr, "error: usrp_source::set_gain\n");
-		return -1;
+
+	if(g_profile)
+		profile_start();
+
+	if(server_path) {
+		r = server_run(u, server_path, precision, confidence, track,
+		   window, bursts, cache, agc, gain);
+		if(g_profile)
+			profile_report(stderr, profile_format);
+		delete cache;
+		return r;
 	}
 
 	if(!bts_scan) {
-		if(!u->tune(freq)) {
-			fprintf(stderr, "error: usrp_source::tune\n");
-			return -1;
+		fprintf(stderr, "%s: %s.\n", basename(argv[0]), record_path?
+		   "Recording" : "Calculating clock frequency offset");
+
+		for(i = 0; i < device_count; i++) {
+			u = us[i];
+			if(!u->tune(dev_freq[i])) {
+				fprintf(stderr, "error: usrp_source::tune\n");
+				return -1;
+			}
+
+			if(device_count > 1)
+				fprintf(stderr, "Device %d: ", i);
+			fprintf(stderr, "Using %s channel %d (%.1fMHz)\n",
+			   bi_to_str(dev_bi[i]), dev_chan[i], dev_freq[i] / 1e6);
+
+			if(agc) {
+				g = gain;
+				u->start();
+				r = gain_range(u, &g);
+				u->stop();
+				if(r) {
+					fprintf(stderr, "error: gain_range\n");
+					return -1;
+				}
+				fprintf(stderr, "Using gain %.1f%%\n", 100.0 * g);
+			}
 		}
+		u = us[0];
 
-		fprintf(stderr, "%s: Calculating clock frequency offset.\n",
-		   basename(argv[0]));
-		fprintf(stderr, "Using %s channel %d (%.1fMHz)\n",
-		   bi_to_str(bi), chan, freq / 1e6);
+		if(archive_path) {
+			archive = new burst_archive(archive_path);
+			if(archive->open(true))
+				return -1;
+		}
+
+		if(monitor)
+			return offset_monitor(u, dev_freq[0], track, window, archive);
+		if(record_path)
+			r = iq_record(u, record_path, record_format, record_len);
+		else if(device_count > 1) {
+			r = offset_detect_all(us, device_count, precision,
+			   confidence, track, window, bursts, archive, dev_freq);
+		} else {
+			r = offset_detect(u, precision, confidence, track,
+			   window, bursts, archive, dev_freq[0]);
+		}
+		delete archive;
+	} else {
+		fprintf(stderr, "%s: Scanning for ", basename(argv[0]));
+		for(i = 0; i < band_count; i++)
+			fprintf(stderr, "%s%s", i? ", " : "", bi_to_str(bands[i]));
+		fprintf(stderr, " base stations.\n");
 
-		return offset_detect(u);
+		r = c0_detect(us, device_count, bands, band_count, cache,
+		   sweep, agc, gain, have_only? only : 0, have_ref? ref : 0);
 	}
 
-	fprintf(stderr, "%s: Scanning for %s base stations.\n",
-	   basename(argv[0]), bi_to_str(bi));
+	if(g_profile)
+		profile_report(stderr, profile_format);
 
-	return c0_detect(u, bi);
+	return r;
 }
@@ -25,45 +25,382 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <vector>
+
 #include "usrp_source.h"
 #include "fcch_detector.h"
+#include "fcch_combiner.h"
+#include "sch_decoder.h"
+#include "drift_stats.h"
+#include "burst_archive.h"
+#include "arfcn_freq.h"
+#include "statistics.h"
+#include "profile.h"
+#include "offset.h"
 #include "util.h"
 
 
 static const unsigned int	AVG_COUNT	= 100;
 static const unsigned int	AVG_THRESHOLD	= (AVG_COUNT / 10);
+static const unsigned int	CI_MIN_COUNT	= 20;
 static const float		OFFSET_MAX	= 40e3;
+static const unsigned int	SCAN_MAX	= 4;	// bursts kept per capture
 
 extern int g_verbosity;
 
 
-int offset_detect(usrp_source *u) {
+/*
+ * Frame synchronization.  Once an SCH has been decoded we know the frame
+ * number of an absolute sample position in the stream, and so where every
+ * later FCCH burst will be.  Those bursts are measured directly with
+ * freq_detect() and the adaptive filter is skipped.  The SCH following each
+ * predicted FCCH is decoded again to follow any timing drift.
+ *
+ * Without an SCH decoder this only follows the stream position, so bursts
+ * in the overlap between scans are only reported once.
+ */
+struct fcch_sync {
+	sch_decoder		*sch;
+	int			synced;
+	unsigned int		fn,		// frame of the last SCH
+				misses;
+	double			pos;		// absolute sample index of that SCH
+	float			offset;		// last measured offset
+	unsigned long long	base,		// absolute sample index of peek()
+				seen;		// end of the last burst reported
+	int			window,		// use timed captures when synced
+				windowed;	// continuous stream is stopped
+	burst_archive		*archive;	// measured bursts are kept here
+	double			freq;		// of the carrier, for the archive
+	int			chan,
+				bi;
+};
+
+static const unsigned int	SYNC_MISSES_MAX	= 3;
+static const float		SCH_ACQ_SEARCH	= 40.0;	// symbols
+static const float		SCH_TRACK_SEARCH = 4.0;	// symbols
+static const float		WINDOW_MARGIN	= 8.0;	// symbols
+static const double		WINDOW_LEAD	= 0.01;	// seconds
+
 
-	static const double GSM_RATE = 1625000.0 / 6.0;
+static void consume(circular_buffer *cb, fcch_sync *sy, unsigned int len) {
 
-	unsigned int new_overruns = 0, overruns = 0;
-	int notfound = 0;
-	unsigned int s_len, b_len, consumed, count;
-	float offset = 0.0, min = 0.0, max = 0.0, avg_offset = 0.0,
-	   stddev = 0.0, sps, offsets[AVG_COUNT];
+	profile_timer pt(PROF_RING, len);
+
+	len = cb->purge(len);
+	if(sy)
+		sy->base += len;
+}
+
+
+/*
+ * Archives the len samples at start in s that offset was measured from.
+ */
+static void keep_burst(usrp_source *u, fcch_sync *sy, const complex *s,
+   unsigned int s_len, unsigned int start, unsigned int len, float offset,
+   float pm) {
+
+	double t;
+
+	if(!sy->archive)
+		return;
+	if(u->sample_time(sy->base, &t))
+		t = -1.0;
+	sy->archive->add(s, s_len, start, len, u->sample_rate(), sy->freq,
+	   sy->chan, sy->bi, t, offset, pm);
+}
+
+
+/*
+ * Sets up archiving the bursts measured on the carrier at freq, which is 0
+ * if it isn't known.
+ */
+static void set_archive(fcch_sync *sy, burst_archive *archive, double freq) {
+
+	sy->archive = archive;
+	sy->freq = freq;
+	sy->chan = -1;
+	sy->bi = BI_NOT_DEFINED;
+	if(archive && (freq > 0.0))
+		sy->chan = freq_to_arfcn(freq, &sy->bi);
+}
+
+
+/*
+ * Try to decode the SCH one frame after an FCCH found at position in s.
+ */
+static void acquire(fcch_sync *sy, const complex *s, unsigned int s_len,
+   unsigned int position, float offset, float sps) {
+
+	float start;
+	int bsic;
+	unsigned int fn;
+
+	if(sy->sch->decode(s, s_len, position + sch_decoder::FRAME_LEN * sps,
+	   (unsigned int)(SCH_ACQ_SEARCH * sps), offset, &start, &bsic, &fn))
+		return;
+	if(fn % sch_decoder::MULTIFRAME_LEN % 10 != 1)
+		return;
+
+	sy->synced = 1;
+	sy->fn = fn;
+	sy->pos = sy->base + start;
+	sy->offset = offset;
+	sy->misses = 0;
+
+	if(g_verbosity > 0) {
+		fprintf(stderr, "\tsynchronized: BSIC %d, FN %u\n", bsic, fn);
+	}
+}
+
+
+/*
+ * Measures the FCCH burst of frame g starting at sample start in s, then
+ * decodes the SCH one frame later to update the timing.  Returns 1 if the
+ * burst gave a sane offset.
+ */
+static int measure_burst(usrp_source *u, fcch_detector *l, fcch_sync *sy,
+   const complex *s, unsigned int s_len, float start, unsigned int g,
+   float sps, float *offset) {
+
+	unsigned int fn, first, len;
+	float freq, pm, sch_start;
+	int bsic, found;
+
+	// skip the symbols at either edge, they are shaped by the neighbors
+	first = (unsigned int)(start + 2 * sps + 0.5);
+	len = (unsigned int)((sch_decoder::BURST_LEN - 4) * sps);
+	freq = l->freq_detect(s + first, len, &pm);
+	freq -= GSM_RATE / 4;
+	found = (pm > fcch_detector::MIN_PM) && (fabs(freq) < OFFSET_MAX);
+	if(found) {
+		sy->offset = freq;
+		keep_burst(u, sy, s, s_len, first, len, freq, pm);
+	}
+
+	if((!sy->sch->decode(s, s_len, start + sch_decoder::FRAME_LEN * sps,
+	   (unsigned int)ceil(SCH_TRACK_SEARCH * sps), sy->offset, &sch_start,
+	   &bsic, &fn)) && (fn == g + 1)) {
+		sy->fn = fn;
+		sy->pos = sy->base + sch_start;
+		sy->misses = 0;
+	} else {
+		sy->fn = g + 1;
+		sy->pos = sy->base + start + sch_decoder::FRAME_LEN * sps;
+		if(++sy->misses > SYNC_MISSES_MAX) {
+			sy->synced = 0;
+			if(g_verbosity > 0) {
+				fprintf(stderr, "\tlost synchronization\n");
+			}
+		}
+	}
+
+	if(found)
+		*offset = freq;
+
+	return found;
+}
+
+
+/*
+ * Measures the next predicted FCCH burst in the continuous stream.  Returns
+ * 0 with an offset, 1 if there was no usable burst, and -1 on error.
+ */
+static int tracked_offset(usrp_source *u, fcch_detector *l, fcch_sync *sy,
+   float *offset, unsigned int *overruns, int *notfound) {
+
+	unsigned int new_overruns = 0, b_len, g;
+	float sps = u->sample_rate() / GSM_RATE, start;
+	double q;
 	complex *cbuf;
-	fcch_detector *l;
-	circular_buffer *cb;
+	circular_buffer *cb = u->get_buffer();
 
-	l = new fcch_detector(u->sample_rate());
+	g = sch_decoder::next_fcch_fn(sy->fn);
+	q = sy->pos + (double)(g - sy->fn) * sch_decoder::FRAME_LEN * sps;
+	if(q < sy->base) {
+		sy->synced = 0;
+		return 1;
+	}
+	start = q - sy->base;
 
-	/*
-	 * We deliberately grab 12 frames and 1 burst.  We are guaranteed to
-	 * find at least one FCCH burst in this much data.
-	 */
-	sps = u->sample_rate() / GSM_RATE;
-	s_len = (unsigned int)ceil((12 * 8 * 156.25 + 156.25) * sps);
-	cb = u->get_buffer();
+	// we need the FCCH and the SCH that follows it
+	if(u->fill((unsigned int)ceil(start + (sch_decoder::FRAME_LEN +
+	   sch_decoder::BURST_LEN + SCH_TRACK_SEARCH) * sps) + 2,
+	   &new_overruns))
+		return -1;
+	if(new_overruns) {
+		*overruns += new_overruns;
+		u->flush();
+		sy->base = 0;
+		sy->synced = 0;
+		return 1;
+	}
+	cbuf = (complex *)cb->peek(&b_len);
 
-	u->start();
-	u->flush();
-	count = 0;
-	while(count < AVG_COUNT) {
+	if(!measure_burst(u, l, sy, cbuf, b_len, start, g, sps, offset)) {
+		consume(cb, sy, (unsigned int)(start + sch_decoder::BURST_LEN * sps));
+		++*notfound;
+		return 1;
+	}
+	consume(cb, sy, (unsigned int)(start + sch_decoder::BURST_LEN * sps));
+
+	return 0;
+}
+
+
+/*
+ * As tracked_offset() but with the continuous stream stopped.  Only a short
+ * window around the next FCCH and its SCH is requested from the device, at
+ * the time predicted from the last SCH.
+ */
+static int windowed_offset(usrp_source *u, fcch_detector *l, fcch_sync *sy,
+   float *offset, unsigned int *overruns, int *notfound) {
+
+	unsigned int new_overruns = 0, b_len, g, len, margin;
+	float rate = u->sample_rate(), sps = rate / GSM_RATE, start;
+	double t_ref, t_q, t_first, now;
+	int r;
+	complex *cbuf;
+	circular_buffer *cb = u->get_buffer();
+
+	if(u->sample_time((unsigned long long)sy->pos, &t_ref)) {
+		sy->synced = 0;
+		return 1;
+	}
+	t_ref += (sy->pos - floor(sy->pos)) / rate;
+
+	margin = (unsigned int)ceil(WINDOW_MARGIN * sps);
+	len = (unsigned int)ceil((sch_decoder::FRAME_LEN +
+	   sch_decoder::BURST_LEN) * sps) + 2 * margin;
+
+	// the first FCCH we still have time to ask for
+	now = u->time_now();
+	g = sy->fn;
+	do {
+		g = sch_decoder::next_fcch_fn(g);
+		t_q = t_ref + (double)(g - sy->fn) * sch_decoder::FRAME_LEN * sps / rate;
+	} while(t_q - margin / rate < now + WINDOW_LEAD);
+
+	// everything buffered is older than the window
+	consume(cb, sy, cb->data_available());
+	sy->windowed = 1;
+	if((r = u->capture(t_q - margin / rate, len, &new_overruns)) < 0)
+		return -1;
+	*overruns += new_overruns;
+	if(r || new_overruns) {
+		consume(cb, sy, cb->data_available());
+		return 1;
+	}
+
+	cbuf = (complex *)cb->peek(&b_len);
+	if(u->sample_time(sy->base, &t_first)) {
+		sy->synced = 0;
+		return 1;
+	}
+	start = (t_q - t_first) * rate;
+
+	if(!measure_burst(u, l, sy, cbuf, b_len, start, g, sps, offset)) {
+		++*notfound;
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Samples of a burst found by scan_all() that its offset came from.
+ */
+static unsigned int burst_len(const fcch_burst *b, float sps) {
+
+	unsigned int max_len = (unsigned int)(sch_decoder::BURST_LEN * sps);
+
+	return (b->len < max_len)? b->len : max_len;
+}
+
+
+/*
+ * Combines the sane bursts found in s into one estimate.  Returns 0 with
+ * the offset, or -1 if there weren't two that agree.
+ */
+static int combine(fcch_combiner *fc, const complex *s, unsigned int s_len,
+   const fcch_burst *bursts, unsigned int found, float sps, float *offset) {
+
+	unsigned int i;
+	float o;
+
+	fc->reset();
+	for(i = 0; i < found; i++) {
+		o = bursts[i].offset - GSM_RATE / 4;
+		if(fabs(o) >= OFFSET_MAX)
+			continue;
+		fc->add(s, s_len, bursts[i].position +
+		   burst_len(&bursts[i], sps) / 2.0, o);
+	}
+
+	return fc->estimate(offset);
+}
+
+
+/*
+ * Captures and scans until at least one sane FCCH offset is found.  Every
+ * burst in the capture is used, up to max, and the number of offsets is
+ * left in n.  The stream must already be running.  sy follows the stream
+ * from one call to the next, and if it has an SCH decoder bursts are
+ * predicted from the SCH whenever we are synchronized.  If fc is given the
+ * bursts of each capture are combined into a single offset instead.
+ */
+static int next_offset(usrp_source *u, fcch_detector *l, unsigned int s_len,
+   float *offsets, unsigned int max, unsigned int *n, unsigned int *overruns,
+   int *notfound, fcch_sync *sy, fcch_combiner *fc = 0) {
+
+	unsigned int new_overruns = 0, b_len, consumed, found, i, k,
+	   keep = l->overlap();
+	unsigned long long end;
+	int r;
+	float sps = u->sample_rate() / GSM_RATE, offset;
+	complex *cbuf;
+	circular_buffer *cb = u->get_buffer();
+	fcch_burst bursts[BURSTS_MAX];
+
+	if(fc)
+		max = BURSTS_MAX;
+	else if(max > SCAN_MAX)
+		max = SCAN_MAX;
+	*n = 0;
+
+	// more than is scanned again, so every capture moves the stream on
+	if(s_len <= keep)
+		s_len = keep + 1;
+
+	for(;;) {
+
+		if(sy->synced) {
+			if(sy->window)
+				r = windowed_offset(u, l, sy, offsets, overruns, notfound);
+			else
+				r = tracked_offset(u, l, sy, offsets, overruns, notfound);
+			if(r < 0)
+				return r;
+			if(!r) {
+				*n = 1;
+				return 0;
+			}
+			continue;
+		}
+
+		// restart the stream if we were using timed captures
+		if(sy->windowed) {
+			u->start();
+			u->flush();
+			sy->base = 0;
+			sy->seen = 0;
+			sy->windowed = 0;
+		}
 
 		// ensure at least s_len contiguous samples are read from usrp
 		do {
@@ -71,52 +408,466 @@ int offset_detect(usrp_source *u) {
 				return -1;
 			}
 			if(new_overruns) {
-				overruns += new_overruns;
+				*overruns += new_overruns;
 				u->flush();
+				sy->base = 0;
+				sy->seen = 0;
 			}
 		} while(new_overruns);
 
 		// get a pointer to the next samples
 		cbuf = (complex *)cb->peek(&b_len);
 
-		// search the buffer for a pure tone
-		if(l->scan(cbuf, b_len, &offset, &consumed)) {
+		/*
+		 * Search the buffer for pure tones.  The end of the buffer is
+		 * scanned again next time, with the start of the next capture,
+		 * so drop the bursts we have already reported from it.
+		 */
+		found = l->scan_all(cbuf, b_len, bursts, max, &consumed);
+		for(i = 0, k = 0; i < found; i++) {
+			if(sy->base + bursts[i].position >= sy->seen)
+				bursts[k++] = bursts[i];
+		}
+		found = k;
+		consumed = (consumed > keep)? consumed - keep : 0;
+		if(!found) {
+			consume(cb, sy, consumed);
+			++*notfound;
+			continue;
+		}
+		end = sy->base + bursts[found - 1].position + bursts[found - 1].len;
+
+		if(fc) {
+			r = combine(fc, cbuf, b_len, bursts, found, sps, offsets);
+			for(i = 0; (!r) && (i < found); i++) {
+				offset = bursts[i].offset - GSM_RATE / 4;
+				if(fabs(offset) < OFFSET_MAX) {
+					keep_burst(u, sy, cbuf, b_len,
+					   bursts[i].position,
+					   burst_len(&bursts[i], sps), offset,
+					   bursts[i].pm);
+				}
+			}
+			sy->seen = end;
+			consume(cb, sy, consumed);
+			if(r) {
+				++*notfound;
+				continue;
+			}
+			*n = 1;
+			return 0;
+		}
+
+		for(i = 0; i < found; i++) {
 
 			// FCH is a sine wave at GSM_RATE / 4
-			offset = offset - GSM_RATE / 4;
+			offset = bursts[i].offset - GSM_RATE / 4;
 
 			// sanity check offset
-			if(fabs(offset) < OFFSET_MAX) {
+			if(fabs(offset) >= OFFSET_MAX)
+				continue;
+			keep_burst(u, sy, cbuf, b_len, bursts[i].position,
+			   burst_len(&bursts[i], sps), offset, bursts[i].pm);
 
-				offsets[count] = offset;
-				count += 1;
+			if(sy->sch && (!*n)) {
+				acquire(sy, cbuf, b_len, bursts[i].position, offset,
+				   sps);
 
-				if(g_verbosity > 0) {
-					fprintf(stderr, "\toffset %3u: %.2f\n", count, offset);
+				/*
+				 * Keep the SCH so tracking can start from it.
+				 * Tracking measures the later bursts itself.
+				 */
+				if(sy->synced) {
+					consumed = (unsigned int)(sy->pos - sy->base);
+					offsets[(*n)++] = offset;
+					break;
 				}
 			}
-		} else {
-			++notfound;
+			offsets[(*n)++] = offset;
 		}
+		sy->seen = end;
+		consume(cb, sy, consumed);
+		if(*n)
+			return 0;
+	}
+}
 
-		// consume used samples
-		cb->purge(consumed);
+
+/*
+ * Measures the offset of the carrier the device is tuned to with l, which
+ * may be warm from earlier measurements.  If sch is given FCCH bursts are
+ * tracked by frame number, with timed captures if window is set.
+ *
+ * If bursts is more than one, each capture is made long enough for that
+ * many FCCH bursts and they are combined into one offset.  Tracking isn't
+ * used then, and AVG_COUNT / bursts offsets take as long to capture as
+ * AVG_COUNT single bursts.
+ *
+ * If precision is non-zero, stop as soon as the confidence interval of the
+ * trimmed mean is within +/- precision Hz.  AVG_COUNT is still the upper
+ * bound.
+ *
+ * If archive is given every burst an offset is taken from is added to it,
+ * as measured on the carrier at freq.
+ *
+ * A recording that runs out ends the measurement with what was found in
+ * it, which may be nothing: res->count is then 0.
+ */
+int offset_measure(usrp_source *u, fcch_detector *l, sch_decoder *sch,
+   float precision, float confidence, int window, unsigned int bursts,
+   offset_result *res, burst_archive *archive, double freq) {
+
+	unsigned int s_len, count, n, last, b_len, avg_count = AVG_COUNT,
+	   ci_min_count = CI_MIN_COUNT;
+	float sps, offsets[AVG_COUNT], scratch[AVG_COUNT];
+	double ci, mean;
+	fcch_sync sy;
+	fcch_combiner *fc = 0;
+	complex *b;
+
+	memset(res, 0, sizeof(*res));
+	if(bursts > BURSTS_MAX)
+		return -1;
+	memset(&sy, 0, sizeof(sy));
+	set_archive(&sy, archive, freq);
+	if(bursts > 1) {
+		fc = new fcch_combiner(u->sample_rate(), bursts);
+		avg_count = AVG_COUNT / bursts;
+		ci_min_count = (CI_MIN_COUNT / bursts > 3)? CI_MIN_COUNT / bursts : 3;
+	} else {
+		sy.sch = sch;
+		sy.window = window;
+	}
+
+	/*
+	 * We deliberately grab 12 frames and 1 burst.  We are guaranteed to
+	 * find at least one FCCH burst in this much data, and FCCH bursts are
+	 * never more than 11 frames apart for each one after that.
+	 */
+	sps = u->sample_rate() / GSM_RATE;
+	s_len = (unsigned int)ceil(((12 + 11 * (fc? bursts - 1 : 0)) * 8 *
+	   156.25 + 156.25) * sps);
+
+	u->start();
+	u->flush();
+
+	// the level of the carrier, from a capture left for the scan
+	if((!u->fill(s_len, &n)) && (!n)) {
+		b = (complex *)u->get_buffer()->peek(&b_len);
+		res->power = sqrt(vectornorm2(b, s_len));
+	}
+
+	count = 0;
+	{
+		profile_timer pt(PROF_OFFSET);
+
+		while(count < avg_count) {
+			if(next_offset(u, l, s_len, offsets + count,
+			   avg_count - count, &n, &res->overruns,
+			   &res->notfound, &sy, fc)) {
+				if(u->exhausted())
+					break;
+				u->stop();
+				delete fc;
+				return -1;
+			}
+
+			last = count;
+			count += n;
+
+			if(g_verbosity > 0) {
+				for(; last < count; last++) {
+					fprintf(stderr, "\toffset %3u: %.2f\n",
+					   last + 1, offsets[last]);
+				}
+			}
+
+			// sequential test on the trimmed mean
+			if((precision > 0.0) && (count >= ci_min_count)) {
+				profile_timer pt(PROF_STATS, count);
+
+				memcpy(scratch, offsets, count * sizeof(float));
+				ci = trimmed_ci(scratch, count, count * AVG_THRESHOLD / AVG_COUNT, confidence, &mean);
+				if(g_verbosity > 0) {
+					fprintf(stderr, "\t\tmean: %.2lf +/- %.2lf\n", mean, ci);
+				}
+				if((ci >= 0.0) && (ci <= precision)) {
+					res->reached = 1;
+					break;
+				}
+			}
+		}
 	}
+	profile_count(PROF_RETRIES, res->notfound);
 
 	u->stop();
-	delete l;
+	delete fc;
 
 	// construct stats
-	sort(offsets, AVG_COUNT);
-	avg_offset = avg(offsets + AVG_THRESHOLD, AVG_COUNT - 2 * AVG_THRESHOLD, &stddev);
-	min = offsets[AVG_THRESHOLD];
-	max = offsets[AVG_COUNT - AVG_THRESHOLD - 1];
+	if(count) {
+		profile_timer pt(PROF_STATS, count);
+		res->offset = trimmed_mean(offsets, count, count * AVG_THRESHOLD / AVG_COUNT, &res->stddev, &res->min, &res->max);
+	}
+	res->count = count;
+
+	return 0;
+}
+
 
+static void report(offset_result *res, float precision, float confidence) {
+
+	if(!res->count) {
+		printf("no FCCH found before the end of the recording\n");
+		return;
+	}
 	printf("average\t\t[min, max]\t(range, stddev)\n");
-	display_freq(avg_offset);
-	printf("\t\t[%d, %d]\t(%d, %f)\n", (int)round(min), (int)round(max), (int)round(max - min), stddev);
-	printf("overruns: %u\n", overruns);
-	printf("not found: %u\n", notfound);
+	display_freq(res->offset);
+	printf("\t\t[%d, %d]\t(%d, %f)\n", (int)round(res->min), (int)round(res->max), (int)round(res->max - res->min), res->stddev);
+	printf("overruns: %u\n", res->overruns);
+	printf("not found: %u\n", res->notfound);
+	if(precision > 0.0) {
+		printf("measurements: %u (+/- %.2fHz at %.0f%%%s)\n", res->count,
+		   precision, 100.0 * confidence,
+		   res->reached? "" : ", not reached");
+	}
+}
+
+
+int offset_detect(usrp_source *u, float precision, float confidence, int track, int window, unsigned int bursts, burst_archive *archive, double freq) {
+
+	fcch_detector *l;
+	sch_decoder *sch = 0;
+	offset_result res;
+	int r;
+
+	l = new fcch_detector(u->sample_rate());
+	if(track || window)
+		sch = new sch_decoder(u->sample_rate());
+	r = offset_measure(u, l, sch, precision, confidence, window, bursts,
+	   &res, archive, freq);
+	delete sch;
+	delete l;
+	if(r)
+		return -1;
+
+	report(&res, precision, confidence);
+
+	return res.count? 0 : -1;
+}
+
+
+struct offset_job {
+	usrp_source *	u;
+	float		precision,
+			confidence;
+	int		track,
+			window;
+	unsigned int	bursts;
+	burst_archive *	archive;
+	double		freq;
+
+	offset_result	res;
+	int		r;
+	pthread_t	tid;
+	int		running;
+};
+
+
+static void *offset_thread(void *arg) {
+
+	offset_job *job = (offset_job *)arg;
+	fcch_detector *l;
+	sch_decoder *sch = 0;
+
+	l = new fcch_detector(job->u->sample_rate());
+	if(job->track || job->window)
+		sch = new sch_decoder(job->u->sample_rate());
+	job->r = offset_measure(job->u, l, sch, job->precision,
+	   job->confidence, job->window, job->bursts, &job->res, job->archive,
+	   job->freq);
+	delete sch;
+	delete l;
 
 	return 0;
 }
+
+
+/*
+ * As offset_detect() for each of the u_count devices in u at the same time,
+ * each on whatever channel it is tuned to, freqs[i] for device i.  The
+ * results are printed in the order of the devices, once they are all done.
+ * Returns -1 if any failed.
+ */
+int offset_detect_all(usrp_source **u, int u_count, float precision, float confidence, int track, int window, unsigned int bursts, burst_archive *archive, const double *freqs) {
+
+	std::vector<offset_job> jobs(u_count);
+	int i, r = 0;
+
+	for(i = 0; i < u_count; i++) {
+		jobs[i].u = u[i];
+		jobs[i].precision = precision;
+		jobs[i].confidence = confidence;
+		jobs[i].track = track;
+		jobs[i].window = window;
+		jobs[i].bursts = bursts;
+		jobs[i].archive = archive;
+		jobs[i].freq = freqs? freqs[i] : 0.0;
+		jobs[i].r = -1;
+		jobs[i].running = 0;
+	}
+	for(i = 1; i < u_count; i++) {
+		if(pthread_create(&jobs[i].tid, 0, offset_thread, &jobs[i])) {
+			fprintf(stderr, "error: offset_detect: pthread_create\n");
+			continue;
+		}
+		jobs[i].running = 1;
+	}
+	offset_thread(&jobs[0]);
+	for(i = 1; i < u_count; i++) {
+		if(jobs[i].running)
+			pthread_join(jobs[i].tid, 0);
+	}
+
+	for(i = 0; i < u_count; i++) {
+		printf("%sdevice %d:\n", i? "\n" : "", i);
+		if(jobs[i].r) {
+			printf("failed\n");
+			r = -1;
+			continue;
+		}
+		report(&jobs[i].res, precision, confidence);
+		if(!jobs[i].res.count)
+			r = -1;
+	}
+
+	return r;
+}
+
+
+/*
+ * Runs until the device fails, printing one line per measured offset:
+ *
+ *	time  offset  mean  stddev  ppm  adev(tau)...
+ *
+ * mean and stddev are over the trimmed window of the last AVG_COUNT offsets
+ * and ppm is the mean relative to the carrier.  The Allan deviations are of
+ * the fractional frequency and are printed as "-" until enough blocks have
+ * been seen.
+ */
+int offset_monitor(usrp_source *u, double carrier, int track, int window, burst_archive *archive) {
+
+	unsigned int overruns = 0, i, s_len, n;
+	int notfound = 0;
+	float offset = 0.0, stddev = 0.0, sps;
+	double t, mean, a, tau;
+	struct timeval tv;
+	fcch_detector *l;
+	drift_stats *ds;
+	fcch_sync sy;
+
+	l = new fcch_detector(u->sample_rate());
+	ds = new drift_stats(carrier, AVG_COUNT);
+	memset(&sy, 0, sizeof(sy));
+	set_archive(&sy, archive, carrier);
+	if(track || window) {
+		sy.sch = new sch_decoder(u->sample_rate());
+		sy.window = window;
+	}
+
+	sps = u->sample_rate() / GSM_RATE;
+	s_len = (unsigned int)ceil((12 * 8 * 156.25 + 156.25) * sps);
+
+	printf("# time\t\toffset\t\tmean\t\tstddev\tppm");
+	for(i = 0; i < drift_stats::ADEV_LEVELS; i++)
+		printf("\tadev%u", i);
+	printf("\n");
+	fflush(stdout);
+
+	u->start();
+	u->flush();
+	for(;;) {
+		// one burst per line, each stamped when it was measured
+		if(next_offset(u, l, s_len, &offset, 1, &n, &overruns, &notfound,
+		   &sy))
+			break;
+
+		gettimeofday(&tv, 0);
+		t = tv.tv_sec + tv.tv_usec / 1e6;
+		{
+			profile_timer pt(PROF_STATS, 1);
+			ds->add(offset, t);
+			mean = ds->trimmed_mean(&stddev);
+		}
+
+		printf("%.3lf\t%10.2f\t%10.2lf\t%7.2f\t%+.4lf", t, offset,
+		   mean, stddev, 1e6 * mean / carrier);
+		for(i = 0; i < drift_stats::ADEV_LEVELS; i++) {
+			if((a = ds->adev(i, &tau)) < 0.0)
+				printf("\t-");
+			else
+				printf("\t%.3e@%.3gs", a, tau);
+		}
+		printf("\n");
+		fflush(stdout);
+
+		if(g_verbosity > 0) {
+			fprintf(stderr, "\toverruns: %u\tnot found: %d\n",
+			   overruns, notfound);
+		}
+	}
+
+	u->stop();
+	delete sy.sch;
+	delete ds;
+	delete l;
+
+	return -1;
+}
+
+
+/*
+ * Measures the bursts in an archive again, printing one line per burst:
+ *
+ *	chan  band  time  offset  pm  remeasured  pm
+ *
+ * time is the device time of the burst, or when it was archived if that
+ * wasn't known.  Returns -1 if the archive couldn't be read.
+ */
+int offset_replay(const char *path) {
+
+	burst_archive *ar;
+	burst_record rec;
+	complex *s;
+	fcch_detector *l = 0;
+	float rate = 0.0, freq, pm;
+	unsigned int count = 0;
+	int r;
+
+	ar = new burst_archive(path);
+	if(ar->open(false)) {
+		delete ar;
+		return -1;
+	}
+
+	printf("# chan\tband\ttime\t\t\toffset\t\tpm\tremeasured\tpm\n");
+	while(!(r = ar->next(&rec, &s))) {
+		if((!l) || (rec.rate != rate)) {
+			delete l;
+			rate = rec.rate;
+			l = new fcch_detector(rate);
+		}
+		freq = l->freq_detect(s + rec.start, rec.burst, &pm) - GSM_RATE / 4;
+		printf("%d\t%s\t%.6lf\t%10.2f\t%.1f\t%10.2f\t%.1f\n", rec.chan,
+		   bi_to_str(rec.bi), (rec.when < 0.0)? rec.wall : rec.when,
+		   rec.offset, rec.pm, freq, pm);
+		count++;
+	}
+	delete l;
+	delete ar;
+
+	if(g_verbosity > 0) {
+		fprintf(stderr, "%u bursts\n", count);
+	}
+
+	return (r < 0)? -1 : 0;
+}
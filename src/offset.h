@@ -25,4 +25,29 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-int offset_detect(usrp_source *u);
+class fcch_detector;
+class sch_decoder;
+class burst_archive;
+
+struct offset_result {
+	float		offset,		// trimmed mean
+			stddev,
+			min,
+			max;
+	unsigned int	count,		// offsets measured
+			overruns;
+	int		notfound,	// captures without a usable burst
+			reached;	// met the precision asked for
+	double		power;		// RMS of the first capture
+};
+
+// most FCCH bursts combined into one offset
+static const unsigned int BURSTS_MAX = 16;
+
+int offset_measure(usrp_source *u, fcch_detector *l, sch_decoder *sch,
+   float precision, float confidence, int window, unsigned int bursts,
+   offset_result *res, burst_archive *archive = 0, double freq = 0.0);
+int offset_detect(usrp_source *u, float precision = 0.0, float confidence = 0.95, int track = 0, int window = 0, unsigned int bursts = 1, burst_archive *archive = 0, double freq = 0.0);
+int offset_detect_all(usrp_source **u, int u_count, float precision = 0.0, float confidence = 0.95, int track = 0, int window = 0, unsigned int bursts = 1, burst_archive *archive = 0, const double *freqs = 0);
+int offset_monitor(usrp_source *u, double carrier, int track = 0, int window = 0, burst_archive *archive = 0);
+int offset_replay(const char *path);
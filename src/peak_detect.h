@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * peak_detect
+ *
+ * Finds the peak of a spectrum to a fraction of a bin by sinc
+ * interpolation.  Kept in a header so callers other than fcch_detector,
+ * such as the benchmarks, get the same inlined code.
+ */
+
+#pragma once
+
+#include <math.h>
+
+#include "usrp_complex.h"
+
+
+static inline float sinc(const float x) {
+
+	if((x <= -0.0001) || (0.0001 <= x))
+		return sinf(x) / x;
+	return 1.0;
+}
+
+
+static inline complex interpolate_point(const complex *s, const unsigned int s_len, const float s_i) {
+
+	static const unsigned int filter_len = 21;
+
+	int start, end, i;
+	unsigned int d;
+	complex point;
+
+	d = (filter_len - 1) / 2;
+	start = (int)(floor(s_i) - d);
+	end = (int)(floor(s_i) + d + 1);
+	if(start < 0)
+		start = 0;
+	if(end > (int)(s_len - 1))
+		end = s_len - 1;
+	for(point = 0.0, i = start; i <= end; i++)
+		point += s[i] * sinc(M_PI * (i - s_i));
+	return point;
+}
+
+
+static inline float peak_detect(const complex *s, const unsigned int s_len, complex *peak, float *avg_power) {
+
+	unsigned int i;
+	float max = -1.0, max_i = -1.0, sample_power, sum_power, early_i, late_i, incr;
+	complex early_p, late_p, cmax;
+
+	sum_power = 0;
+	for(i = 0; i < s_len; i++) {
+		sample_power = norm(s[i]);
+		sum_power += sample_power;
+		if(sample_power > max) {
+			max = sample_power;
+			max_i = i;
+		}
+	}
+	early_i = (1 <= max_i)? (max_i - 1) : 0;
+	late_i = (max_i + 1 < s_len)? (max_i + 1) : s_len - 1;
+
+	incr = 0.5;
+	while(incr > 1.0 / 1024.0) {
+		early_p = interpolate_point(s, s_len, early_i);
+		late_p = interpolate_point(s, s_len, late_i);
+		if(norm(early_p) < norm(late_p))
+			early_i += incr;
+		else if(norm(early_p) > norm(late_p))
+			early_i -= incr;
+		else
+			break;
+		incr /= 2.0;
+		late_i = early_i + 2.0;
+	}
+	max_i = early_i + 1.0;
+	cmax = interpolate_point(s, s_len, max_i);
+
+	if(peak)
+		*peak = cmax;
+
+	if(avg_power)
+		*avg_power = (sum_power - norm(cmax)) / (s_len - 1);
+
+	return max_i;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <time.h>
+#include <math.h>
+
+#include "profile.h"
+
+static const char * const stage_name[PROF_STAGES] = {
+	"other",
+	"tune",
+	"gain",
+	"flush",
+	"fill",
+	"convert",
+	"codec",
+	"ring",
+	"scan",
+	"lms",
+	"fft",
+	"sch",
+	"stats",
+	"c0_power",
+	"c0_fcch",
+	"offset"
+};
+
+static const char * const counter_name[PROF_COUNTERS] = {
+	"candidates",
+	"ffts",
+	"detections",
+	"retries"
+};
+
+// pm histogram bins are powers of two: [0, 1), [1, 2), [2, 4), ...
+static const unsigned int PM_BINS = 12;
+
+unsigned long long g_profile_count[PROF_COUNTERS];
+
+static unsigned long long g_self[PROF_STAGES],
+			  g_total[PROF_STAGES],
+			  g_calls[PROF_STAGES],
+			  g_samples[PROF_STAGES],
+			  g_pm_hist[PM_BINS],
+			  g_start_ticks = 0,
+			  g_start_ns = 0,
+			  g_mark = 0;
+static unsigned int	  g_current = PROF_OTHER;
+
+
+unsigned long long profile_now() {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+void profile_start() {
+
+	unsigned int i;
+
+	for(i = 0; i < PROF_STAGES; i++) {
+		g_self[i] = 0;
+		g_total[i] = 0;
+		g_calls[i] = 0;
+		g_samples[i] = 0;
+	}
+	for(i = 0; i < PROF_COUNTERS; i++)
+		g_profile_count[i] = 0;
+	for(i = 0; i < PM_BINS; i++)
+		g_pm_hist[i] = 0;
+	g_current = PROF_OTHER;
+	g_start_ns = profile_now();
+	g_start_ticks = g_mark = profile_ticks();
+}
+
+
+/*
+ * Pauses the running stage and starts stage.  Returns the stage to go back
+ * to.
+ */
+unsigned int profile_enter(const unsigned int stage, unsigned long long *start) {
+
+	unsigned long long now = profile_ticks();
+	unsigned int prev = g_current;
+
+	g_self[g_current] += now - g_mark;
+	g_current = stage;
+	g_mark = now;
+	*start = now;
+
+	return prev;
+}
+
+
+void profile_leave(const unsigned int stage, const unsigned int prev, const unsigned long long start, const unsigned long long samples) {
+
+	unsigned long long now = profile_ticks();
+
+	g_self[stage] += now - g_mark;
+	g_total[stage] += now - start;
+	g_calls[stage] += 1;
+	g_samples[stage] += samples;
+	g_current = prev;
+	g_mark = now;
+}
+
+
+void profile_pm_add(const float pm) {
+
+	unsigned int bin = 0;
+
+	if(pm >= 1.0)
+		bin = 1 + (unsigned int)floor(log2(pm));
+	if(bin >= PM_BINS)
+		bin = PM_BINS - 1;
+	g_pm_hist[bin] += 1;
+}
+
+
+static void report_human(FILE *fp, double elapsed, double tick_ns) {
+
+	unsigned int i;
+	double self, total;
+
+	fprintf(fp, "profile: %.3f s elapsed\n", elapsed / 1e9);
+	fprintf(fp, "\t%-9s %9s %6s %9s %9s %12s %9s %9s\n", "stage", "self (s)",
+	   "%", "total (s)", "calls", "samples", "Msps", "ns/sample");
+	for(i = 0; i < PROF_STAGES; i++) {
+		self = g_self[i] * tick_ns;
+		total = g_total[i] * tick_ns;
+		if((i != PROF_OTHER) && (!g_calls[i]))
+			continue;
+		fprintf(fp, "\t%-9s %9.3f %6.1f", stage_name[i], self / 1e9,
+		   100.0 * self / elapsed);
+		if(i == PROF_OTHER) {
+			fprintf(fp, "\n");
+			continue;
+		}
+		fprintf(fp, " %9.3f %9llu %12llu", total / 1e9, g_calls[i],
+		   g_samples[i]);
+		if(g_samples[i] && (total > 0.0))
+			fprintf(fp, " %9.2f %9.1f\n", g_samples[i] * 1e3 / total,
+			   total / g_samples[i]);
+		else
+			fprintf(fp, " %9s %9s\n", "-", "-");
+	}
+
+	fprintf(fp, "\t");
+	for(i = 0; i < PROF_COUNTERS; i++)
+		fprintf(fp, "%s%s: %llu", i? ", " : "", counter_name[i],
+		   g_profile_count[i]);
+	fprintf(fp, "\n\tpm:");
+	for(i = 0; i < PM_BINS; i++) {
+		if(g_pm_hist[i])
+			fprintf(fp, " [%u, %u%s): %llu", i? 1u << (i - 1) : 0,
+			   1u << i, (i == PM_BINS - 1)? "+" : "", g_pm_hist[i]);
+	}
+	fprintf(fp, "\n");
+}
+
+
+static void report_json(FILE *fp, double elapsed, double tick_ns) {
+
+	unsigned int i;
+
+	fprintf(fp, "{\"elapsed\": %.6f, \"stages\": {", elapsed / 1e9);
+	for(i = 0; i < PROF_STAGES; i++) {
+		fprintf(fp, "%s\"%s\": {\"self\": %.6f, \"total\": %.6f, "
+		   "\"calls\": %llu, \"samples\": %llu}", i? ", " : "",
+		   stage_name[i], g_self[i] * tick_ns / 1e9,
+		   g_total[i] * tick_ns / 1e9, g_calls[i], g_samples[i]);
+	}
+	fprintf(fp, "}, \"counters\": {");
+	for(i = 0; i < PROF_COUNTERS; i++)
+		fprintf(fp, "%s\"%s\": %llu", i? ", " : "", counter_name[i],
+		   g_profile_count[i]);
+	fprintf(fp, "}, \"pm_histogram\": [");
+	for(i = 0; i < PM_BINS; i++)
+		fprintf(fp, "%s%llu", i? ", " : "", g_pm_hist[i]);
+	fprintf(fp, "]}\n");
+}
+
+
+void profile_report(FILE *fp, const int format) {
+
+	unsigned long long now = profile_ticks(), ns = profile_now();
+	double elapsed, tick_ns;
+
+	// charge whatever is running now
+	g_self[g_current] += now - g_mark;
+	g_mark = now;
+
+	elapsed = ns - g_start_ns;
+	if(elapsed <= 0.0)
+		elapsed = 1.0;
+	tick_ns = (now > g_start_ticks)? elapsed / (now - g_start_ticks) : 1.0;
+
+	if(format == PROF_JSON)
+		report_json(fp, elapsed, tick_ns);
+	else
+		report_human(fp, elapsed, tick_ns);
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * profile
+ *
+ * Where the time goes, reported at exit when kal is run with -P, either as
+ * a table or as JSON (-T json).  With a file or simulated device, which
+ * deliver samples as fast as we can take them, the report is also a
+ * throughput figure for the whole pipeline on this host.
+ *
+ * Stages are timed with profile_timer, a scoped timer read from the TSC
+ * where there is one.  Timers nest: while an inner stage runs the outer
+ * one is paused, so each stage's own time excludes what it called and the
+ * own times add up to the elapsed time.  A stage's total time includes
+ * its callees.  Counters record detector events and the distribution of
+ * the FCCH peak-to-mean ratio.
+ *
+ * Everything is always compiled in.  With profiling off a timer or counter
+ * costs one branch.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+enum {
+	PROF_OTHER,		// outside any stage
+	PROF_TUNE,		// retuning the device
+	PROF_GAIN,		// automatic gain ranging
+	PROF_FLUSH,		// discarding stale samples
+	PROF_FILL,		// waiting for and receiving samples
+	PROF_CONVERT,		// sample conversion and resampling
+	PROF_CODEC,		// recording block compression
+	PROF_RING,		// sample buffer writes and purges
+	PROF_SCAN,		// fcch_detector::scan
+	PROF_LMS,		// adaptive filter error
+	PROF_FFT,		// FFT and peak estimation
+	PROF_SCH,		// SCH decoding
+	PROF_STATS,		// offset statistics
+	PROF_C0_POWER,		// c0_detect() power pass
+	PROF_C0_FCCH,		// c0_detect() FCCH pass
+	PROF_OFFSET,		// offset_detect() measurement loop
+	PROF_STAGES
+};
+
+enum {
+	PROF_CANDIDATES,	// low error runs long enough to be an FCCH
+	PROF_FFTS,		// FFTs executed
+	PROF_DETECTIONS,	// candidates whose pm passed
+	PROF_RETRIES,		// captures repeated after no FCCH was found
+	PROF_COUNTERS
+};
+
+extern int g_profile;
+
+enum {
+	PROF_HUMAN,
+	PROF_JSON
+};
+
+unsigned long long profile_now();
+void profile_start();
+unsigned int profile_enter(const unsigned int stage, unsigned long long *start);
+void profile_leave(const unsigned int stage, const unsigned int prev, const unsigned long long start, const unsigned long long samples);
+void profile_pm_add(const float pm);
+void profile_report(FILE *fp, const int format = PROF_HUMAN);
+
+extern unsigned long long g_profile_count[PROF_COUNTERS];
+
+
+/*
+ * Cycle counter where there is one, nanoseconds otherwise.  profile_report
+ * converts using the rate measured over the run.
+ */
+static inline unsigned long long profile_ticks() {
+
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((unsigned long long)hi << 32) | lo;
+#else
+	return profile_now();
+#endif
+}
+
+
+static inline void profile_count(const unsigned int counter, const unsigned long long n = 1) {
+
+	if(g_profile)
+		g_profile_count[counter] += n;
+}
+
+
+static inline void profile_pm(const float pm) {
+
+	if(g_profile)
+		profile_pm_add(pm);
+}
+
+
+class profile_timer {
+public:
+	profile_timer(const unsigned int stage, const unsigned long long samples = 0) {
+
+		m_stage = stage;
+		m_samples = samples;
+		if(g_profile)
+			m_prev = profile_enter(stage, &m_start);
+	};
+
+	~profile_timer() {
+
+		if(g_profile)
+			profile_leave(m_stage, m_prev, m_start, m_samples);
+	};
+
+	void samples(const unsigned long long samples) { m_samples = samples; };
+
+private:
+	unsigned int		m_stage,
+				m_prev;
+	unsigned long long	m_start,
+				m_samples;
+};
@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdexcept>
+#include <vector>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif /* __SSE__ */
+
+#include "resampler.h"
+#include "rt.h"
+
+static const double KAISER_BETA = 8.0;
+static const double REJECT_MIN = 60.0;		// dB, where images fold back
+static const unsigned int K_MAX = 256;		// taps per phase
+
+
+/*
+ * Best rational approximation n / d of x with n, d <= max, by continued
+ * fractions.
+ */
+static void rational(double x, unsigned int max, unsigned int *n, unsigned int *d) {
+
+	unsigned long p0 = 0, q0 = 1, p1 = 1, q1 = 0, p2, q2, a;
+	double r = x;
+
+	for(;;) {
+		a = (unsigned long)floor(r);
+		p2 = a * p1 + p0;
+		q2 = a * q1 + q0;
+		if((p2 > max) || (q2 > max))
+			break;
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+		if(fabs(r - a) < 1e-9)
+			break;
+		r = 1.0 / (r - a);
+	}
+
+	*n = p1;
+	*d = q1;
+}
+
+
+static double bessel_i0(double x) {
+
+	double s = 1.0, t = 1.0;
+
+	for(int k = 1; k < 50; k++) {
+		t *= (x / (2.0 * k)) * (x / (2.0 * k));
+		s += t;
+		if(t < 1e-12 * s)
+			break;
+	}
+
+	return s;
+}
+
+
+static float *aligned_floats(unsigned int len) {
+
+	void *p;
+
+	if(posix_memalign(&p, 16, len * sizeof(float)))
+		throw std::runtime_error("resampler: posix_memalign failed");
+	memset(p, 0, len * sizeof(float));
+	rt_memory(p, len * sizeof(float));
+
+	return (float *)p;
+}
+
+
+/*
+ * Kaiser-windowed sinc of len taps cut off at fc, in cycles per sample.
+ */
+static void design(std::vector<double> &h, unsigned int len, double fc) {
+
+	unsigned int n;
+	double x, w, c;
+
+	h.resize(len);
+	for(n = 0; n < len; n++) {
+		x = n - (len - 1) / 2.0;
+		c = (fabs(x) < 1e-9)? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x);
+		w = 2.0 * n / (len - 1) - 1.0;
+		w = bessel_i0(KAISER_BETA * sqrt(1.0 - w * w)) / bessel_i0(KAISER_BETA);
+		h[n] = c * w;
+	}
+}
+
+
+/*
+ * Least attenuation of h, in dB relative to DC, from f0 to f1.
+ */
+static double rejection(const std::vector<double> &h, double f0, double f1) {
+
+	unsigned int n, len = h.size();
+	double f, step = 0.25 / len, dc = 0.0, g, worst = 0.0;
+
+	for(n = 0; n < len; n++)
+		dc += h[n];
+	for(f = f0; f <= f1; f += step) {
+		for(n = 0, g = 0.0; n < len; n++)
+			g += h[n] * cos(2.0 * M_PI * f * (n - (len - 1) / 2.0));
+		if(fabs(g) > worst)
+			worst = fabs(g);
+	}
+
+	return -20.0 * log10(worst / dc);
+}
+
+
+resampler::resampler(const double in_rate, const double out_rate, const unsigned int taps) {
+
+	unsigned int n, len, p, j, r;
+	double fc, nyq;
+	std::vector<double> h;
+
+	if((in_rate <= 0.0) || (out_rate <= 0.0))
+		throw std::runtime_error("resampler: bad rate");
+
+	m_in_rate = in_rate;
+	rational(out_rate / in_rate, MAX_LM, &m_l, &m_m);
+	if((!m_l) || (!m_m))
+		throw std::runtime_error("resampler: no rational approximation");
+
+	/*
+	 * Prototype lowpass at L * in_rate, cut off below the lower nyquist.
+	 * When decimating the transition band has to shrink with the cutoff,
+	 * so there are taps per phase for every input step of an output.
+	 */
+	r = (m_m + m_l - 1) / m_l;
+	m_k = taps * ((r > 1)? r : 1);
+	nyq = 0.5 / ((m_l > m_m)? m_l : m_m);
+	fc = 0.9 * nyq;
+
+	/*
+	 * Whatever is past the lower nyquist folds back on to the passband,
+	 * so from the image of the passband edge on it must be REJECT_MIN
+	 * down.  Lengthen the filter until it is.
+	 */
+	for(;;) {
+		// round the taps per phase up to a multiple of 4 for the inner loop
+		m_k = (m_k + 3) & ~3;
+		len = m_k * m_l;
+		design(h, len, fc);
+		if(rejection(h, 2.0 * nyq - fc, 2.0 * nyq) >= REJECT_MIN)
+			break;
+		if(m_k >= K_MAX)
+			throw std::runtime_error("resampler: stopband not reached");
+		m_k += 4;
+	}
+
+	m_taps = aligned_floats(len);
+	for(n = 0; n < len; n++) {
+		// phase p holds h[p + j * L], reversed
+		p = n % m_l;
+		j = n / m_l;
+		m_taps[p * m_k + (m_k - 1 - j)] = m_l * h[n];
+	}
+
+	m_delay = (len - 1) / (2.0 * m_l);
+
+	m_xr = m_xi = 0;
+	m_cap = 0;
+	m_len = 0;
+	reserve(4096);
+	reset();
+}
+
+
+resampler::~resampler() {
+
+	free(m_taps);
+	free(m_xr);
+	free(m_xi);
+}
+
+
+/*
+ * Forgets the input history, for example after a gap in the input.  The
+ * first output after a reset waits for a full filter's worth of input so
+ * none of the outputs see a partial history.
+ */
+void resampler::reset() {
+
+	m_len = 0;
+	m_i = m_k - 1;
+	m_p = 0;
+}
+
+
+void resampler::reserve(const unsigned int len) {
+
+	float *xr, *xi;
+
+	if(len <= m_cap)
+		return;
+
+	xr = aligned_floats(len);
+	xi = aligned_floats(len);
+	if(m_xr) {
+		memcpy(xr, m_xr, m_len * sizeof(float));
+		memcpy(xi, m_xi, m_len * sizeof(float));
+		free(m_xr);
+		free(m_xi);
+	}
+	m_xr = xr;
+	m_xi = xi;
+	m_cap = len;
+}
+
+
+double resampler::out_rate() {
+
+	return m_in_rate * m_l / m_m;
+}
+
+
+/*
+ * Inputs needed after a reset to be sure of out_len outputs.
+ */
+unsigned int resampler::input_for(const unsigned int out_len) {
+
+	return (unsigned int)(((unsigned long long)out_len * m_m + m_l - 1) / m_l) + m_k;
+}
+
+
+/*
+ * Position, in input samples relative to the next input, that the next
+ * output corresponds to once the filter delay is taken out.  Used to
+ * timestamp the outputs.
+ */
+double resampler::lead() {
+
+	return (double)m_i + (double)m_p / m_l - m_len - m_delay;
+}
+
+
+/*
+ * Input samples between the first input after a reset and the position of
+ * the first output.
+ */
+double resampler::settle() {
+
+	return (m_k - 1) - m_delay;
+}
+
+
+static inline void dot(const float *h, const float *xr, const float *xi, const unsigned int k, float *re, float *im) {
+
+	unsigned int j;
+#ifdef __SSE__
+	__m128 ar = _mm_setzero_ps(), ai = _mm_setzero_ps(), t;
+	float r[4], i[4];
+
+	for(j = 0; j < k; j += 4) {
+		t = _mm_load_ps(h + j);
+		ar = _mm_add_ps(ar, _mm_mul_ps(t, _mm_loadu_ps(xr + j)));
+		ai = _mm_add_ps(ai, _mm_mul_ps(t, _mm_loadu_ps(xi + j)));
+	}
+	_mm_storeu_ps(r, ar);
+	_mm_storeu_ps(i, ai);
+	*re = (r[0] + r[1]) + (r[2] + r[3]);
+	*im = (i[0] + i[1]) + (i[2] + i[3]);
+#else
+	float ar = 0.0, ai = 0.0;
+
+	for(j = 0; j < k; j++) {
+		ar += h[j] * xr[j];
+		ai += h[j] * xi[j];
+	}
+	*re = ar;
+	*im = ai;
+#endif /* __SSE__ */
+}
+
+
+/*
+ * Resamples in_len more inputs.  Returns the number of outputs written, at
+ * most out_max.  Inputs that couldn't be used yet are kept for the next
+ * call.
+ */
+unsigned int resampler::process(const complex *in, const unsigned int in_len, complex *out, const unsigned int out_max) {
+
+	unsigned int j, n = 0, shift;
+	float re, im;
+
+	reserve(m_len + in_len);
+	for(j = 0; j < in_len; j++) {
+		m_xr[m_len + j] = in[j].real();
+		m_xi[m_len + j] = in[j].imag();
+	}
+	m_len += in_len;
+
+	while((m_i < m_len) && (n < out_max)) {
+		dot(m_taps + m_p * m_k, m_xr + m_i + 1 - m_k, m_xi + m_i + 1 - m_k, m_k, &re, &im);
+		out[n++] = complex(re, im);
+		m_p += m_m;
+		m_i += m_p / m_l;
+		m_p %= m_l;
+	}
+
+	// keep the k - 1 samples before the next output's newest input
+	shift = m_i + 1 - m_k;
+	if(shift > m_len)
+		shift = m_len;
+	memmove(m_xr, m_xr + shift, (m_len - shift) * sizeof(float));
+	memmove(m_xi, m_xi + shift, (m_len - shift) * sizeof(float));
+	m_len -= shift;
+	m_i -= shift;
+
+	return n;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * resampler
+ *
+ * Polyphase rational resampler.  The ratio out_rate / in_rate is
+ * approximated by L / M with small L and M, a Kaiser-windowed sinc prototype
+ * is designed at L times the input rate and split into L phases of taps
+ * taps each, times ceil(M / L) when decimating.  The prototype is made
+ * longer still if need be, until everything that would fold back on to
+ * the passband is 60dB down.  Each output is a single dot product of one
+ * phase against the most recent input samples.
+ *
+ * The input history is kept as separate real and imaginary arrays and the
+ * phases are stored reversed so the inner loop runs forward over contiguous,
+ * aligned floats; on x86 it uses SSE.
+ */
+
+#pragma once
+
+#include "usrp_complex.h"
+
+class resampler {
+public:
+	resampler(const double in_rate, const double out_rate, const unsigned int taps = 16);
+	~resampler();
+
+	unsigned int process(const complex *in, const unsigned int in_len, complex *out, const unsigned int out_max);
+	unsigned int input_for(const unsigned int out_len);
+	double lead();
+	double settle();
+	double out_rate();
+	void reset();
+
+	unsigned int interpolation() { return m_l; };
+	unsigned int decimation() { return m_m; };
+
+private:
+	void reserve(const unsigned int len);
+
+	double		m_in_rate,
+			m_delay;	// group delay in input samples
+	unsigned int	m_l,
+			m_m,
+			m_k,
+			m_p,		// current phase
+			m_i,		// newest input used by the next output
+			m_len,		// samples in the history
+			m_cap;
+	float		*m_taps,
+			*m_xr,
+			*m_xi;
+
+	static const unsigned int MAX_LM = 1024;
+};
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* !_GNU_SOURCE */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+static int g_rt_lock = 0, g_rt_lock_failed = 0;
+
+
+// touch every page so it is backed now rather than on first use
+static void prefault(volatile char *c, size_t len) {
+
+	size_t i, pagesize = getpagesize();
+
+	for(i = 0; i < len; i += pagesize)
+		c[i] = c[i];
+	c[len - 1] = c[len - 1];
+}
+
+
+/*
+ * Pins kal to the CPUs in cpus, a list like "2,3" or "1-3,6".
+ */
+int rt_affinity(const char *cpus) {
+
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t set;
+	const char *s = cpus;
+	char *end;
+	long lo, hi, i;
+
+	CPU_ZERO(&set);
+	while(*s) {
+		lo = hi = strtol(s, &end, 10);
+		if((end == s) || (lo < 0))
+			break;
+		if(*end == '-') {
+			s = end + 1;
+			hi = strtol(s, &end, 10);
+			if((end == s) || (hi < lo))
+				break;
+		}
+		for(i = lo; (i <= hi) && (i < CPU_SETSIZE); i++)
+			CPU_SET(i, &set);
+		s = end;
+		if(*s == ',')
+			s++;
+		else if(*s)
+			break;
+	}
+	if(*s || (!CPU_COUNT(&set))) {
+		fprintf(stderr, "error: bad cpu list: ``%s''\n", cpus);
+		return -1;
+	}
+
+	if(sched_setaffinity(0, sizeof(set), &set)) {
+		fprintf(stderr, "cpu affinity: not set: %s\n", strerror(errno));
+		return 1;
+	}
+	fprintf(stderr, "cpu affinity: %s\n", cpus);
+
+	return 0;
+#else
+	fprintf(stderr, "cpu affinity: not supported on this host\n");
+	return 1;
+#endif /* HAVE_SCHED_SETAFFINITY */
+}
+
+
+/*
+ * Runs kal with the real-time SCHED_FIFO policy.  This needs root or
+ * CAP_SYS_NICE, or an rtprio limit of at least priority.
+ */
+int rt_priority(int priority) {
+
+#ifdef HAVE_SCHED_SETSCHEDULER
+	struct sched_param sp;
+	int max = sched_get_priority_max(SCHED_FIFO);
+
+	if(priority > max)
+		priority = max;
+	memset(&sp, 0, sizeof(sp));
+	sp.sched_priority = priority;
+	if(sched_setscheduler(0, SCHED_FIFO, &sp)) {
+		fprintf(stderr, "scheduling: SCHED_FIFO not set: %s\n",
+		   strerror(errno));
+		return 1;
+	}
+	fprintf(stderr, "scheduling: SCHED_FIFO priority %d\n", priority);
+
+	return 0;
+#else
+	fprintf(stderr, "scheduling: SCHED_FIFO not supported on this host\n");
+	return 1;
+#endif /* HAVE_SCHED_SETSCHEDULER */
+}
+
+
+/*
+ * Locks what is mapped now and has rt_memory lock the buffers allocated
+ * from here on.  They are locked individually rather than with
+ * MCL_FUTURE so that a recording being replayed is not read into memory
+ * as a whole.
+ */
+int rt_lock() {
+
+	static const unsigned int STACK_LEN = 256 * 1024;
+
+	volatile char stack[STACK_LEN];
+
+	// fault in the stack the receive path will use
+	prefault(stack, STACK_LEN);
+
+	g_rt_lock = 1;
+#ifdef HAVE_MLOCKALL
+	if(mlockall(MCL_CURRENT)) {
+		fprintf(stderr, "memory: not locked: %s, buffers are prefaulted "
+		   "only\n", strerror(errno));
+		g_rt_lock_failed = 1;
+		return 1;
+	}
+	fprintf(stderr, "memory: locked\n");
+
+	return 0;
+#else
+	fprintf(stderr, "memory: locking not supported on this host, buffers "
+	   "are prefaulted only\n");
+	g_rt_lock_failed = 1;
+	return 1;
+#endif /* HAVE_MLOCKALL */
+}
+
+
+/*
+ * Called for each sample and FFT buffer as it is allocated.  With rt_lock
+ * in effect the buffer is touched page by page so it is backed before
+ * samples arrive, and locked.
+ */
+void rt_memory(void *p, size_t len) {
+
+	if((!g_rt_lock) || (!p) || (!len))
+		return;
+
+	prefault((volatile char *)p, len);
+
+#ifdef HAVE_MLOCK
+	if(g_rt_lock_failed)
+		return;
+	if(mlock(p, len)) {
+		fprintf(stderr, "warning: memory: buffer not locked: %s, buffers "
+		   "are prefaulted only\n", strerror(errno));
+		g_rt_lock_failed = 1;
+	}
+#endif /* HAVE_MLOCK */
+}
+
+
+/*
+ * Initializes attr for a thread that does work the receive path mustn't
+ * wait on, which runs under SCHED_OTHER whatever -q gave the process.
+ */
+void rt_worker(pthread_attr_t *attr) {
+
+#ifdef HAVE_SCHED_SETSCHEDULER
+	struct sched_param sp;
+#endif /* HAVE_SCHED_SETSCHEDULER */
+
+	pthread_attr_init(attr);
+#ifdef HAVE_SCHED_SETSCHEDULER
+	memset(&sp, 0, sizeof(sp));
+	pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(attr, SCHED_OTHER);
+	pthread_attr_setschedparam(attr, &sp);
+#endif /* HAVE_SCHED_SETSCHEDULER */
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * rt
+ *
+ * Host tuning for reliable capture.  Overruns on a busy host come from the
+ * receive path being preempted or stalling on page faults in the sample
+ * buffers.  These apply to the process: they are set up before the device
+ * is opened, and the threads started later, the driver's and kal's capture
+ * threads, inherit the CPU set and scheduling policy.
+ *
+ * The scan's FCCH workers are the exception.  They are CPU-bound, and at
+ * the capture threads' SCHED_FIFO priority a worker on a pinned CPU would
+ * keep a capture thread off it until its job was done, so they are started
+ * with rt_worker() under SCHED_OTHER.
+ *
+ * Each function reports on stderr whether it took effect and returns 0 if
+ * it did.  If the host does not allow it 1 is returned and kal runs as it
+ * would without the option.  -1 is returned for bad arguments.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+
+int rt_affinity(const char *cpus);
+int rt_priority(int priority);
+int rt_lock();
+void rt_memory(void *p, size_t len);
+void rt_worker(pthread_attr_t *attr);
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "sch_decoder.h"
+#include "profile.h"
+#include "util.h"
+
+extern int g_debug;
+
+// 45.002 5.2.5, synchronization burst extended training sequence
+static const unsigned char sch_training[] = {
+	1, 0, 1, 1, 1, 0, 0, 1, 0, 1, 1, 0, 0, 0, 1, 0,
+	0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1,
+	0, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1,
+	0, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 1, 1
+};
+
+static const unsigned int TRAINING_POS		= 42;
+static const unsigned int TRAINING_LEN		= 64;
+static const unsigned int DATA1_POS		= 3;
+static const unsigned int DATA2_POS		= 106;
+static const unsigned int DATA_LEN		= 39;
+
+// 45.003 4.7, 25 information bits, 10 parity bits and 4 tail bits
+static const unsigned int INFO_LEN		= 25;
+static const unsigned int PARITY_LEN		= 10;
+static const unsigned int CONV_LEN		= INFO_LEN + PARITY_LEN + 4;
+static const unsigned int PARITY_POLY		= 0x575;	// D^10 + D^8 + D^6 + D^5 + D^4 + D^2 + 1
+
+static const float MIN_CORRELATION		= 0.5;
+
+
+sch_decoder::sch_decoder(const float sample_rate) {
+
+	m_sample_rate = sample_rate;
+	m_sps = sample_rate / GSM_RATE;
+}
+
+
+sch_decoder::~sch_decoder() {
+
+}
+
+
+/*
+ * FCCH bursts are in frames 0, 10, 20, 30 and 40 of the 51-multiframe.
+ */
+unsigned int sch_decoder::next_fcch_fn(const unsigned int fn) {
+
+	unsigned int t3 = fn % MULTIFRAME_LEN;
+
+	if(t3 >= 40)
+		return fn - t3 + MULTIFRAME_LEN;
+	return fn - t3 % 10 + 10;
+}
+
+
+/*
+ * Returns the derotated symbol k of a burst starting at sample start.  The
+ * carrier offset and the MSK pi/2 per symbol rotation are both removed.
+ */
+static inline complex symbol(const complex *s, const double start, const double sps, const unsigned int k, const double w) {
+
+	double t = start + k * sps, f, ph;
+	unsigned int i = (unsigned int)t;
+	complex z;
+
+	f = t - i;
+	z = s[i] * (float)(1.0 - f) + s[i + 1] * (float)f;
+	ph = -(w * t + M_PI / 2.0 * k);
+
+	return z * complex(cos(ph), sin(ph));
+}
+
+
+/*
+ * Normalized correlation against the extended training sequence.  phase is
+ * set to the unnormalized correlation, which carries the reference phase.
+ */
+float sch_decoder::correlate(const complex *s, const unsigned int s_len, const float start, const float offset, complex *phase) {
+
+	unsigned int k;
+	double w = 2.0 * M_PI * offset / m_sample_rate, energy = 0.0;
+	complex c = 0.0, z;
+
+	if((start < 0.0) || (start + BURST_LEN * m_sps + 1 >= s_len))
+		return 0.0;
+
+	for(k = 0; k < TRAINING_LEN; k++) {
+		z = symbol(s, start, m_sps, TRAINING_POS + k, w);
+		if(sch_training[k])
+			c -= z;
+		else
+			c += z;
+		energy += norm(z);
+	}
+	if(phase)
+		*phase = c;
+	if(energy <= 0.0)
+		return 0.0;
+
+	return abs(c) / sqrt(energy * TRAINING_LEN);
+}
+
+
+/*
+ * Soft bits for both data blocks, positive for 0.
+ */
+int sch_decoder::demod(const complex *s, const unsigned int s_len, const float start, const float offset, const complex phase, float *soft) {
+
+	unsigned int k;
+	double w = 2.0 * M_PI * offset / m_sample_rate;
+	complex ref = std::conj(phase) / abs(phase);
+
+	if((start < 0.0) || (start + BURST_LEN * m_sps + 1 >= s_len))
+		return -1;
+
+	for(k = 0; k < DATA_LEN; k++) {
+		soft[k] = (symbol(s, start, m_sps, DATA1_POS + k, w) * ref).real();
+		soft[DATA_LEN + k] = (symbol(s, start, m_sps, DATA2_POS + k, w) * ref).real();
+	}
+
+	return 0;
+}
+
+
+/*
+ * Rate 1/2, K = 5 convolutional code,
+ *
+ *	G0 = 1 + D^3 + D^4
+ *	G1 = 1 + D + D^3 + D^4
+ *
+ * State is (u(k - 1), ..., u(k - 4)) with u(k - 1) as the high bit.  The
+ * encoder starts and, because of the tail bits, ends in state 0.
+ */
+static inline unsigned int conv_out(const unsigned int state, const unsigned int b) {
+
+	unsigned int u1 = (state >> 3) & 1, u3 = (state >> 1) & 1, u4 = state & 1;
+
+	return ((b ^ u3 ^ u4) << 1) | (b ^ u1 ^ u3 ^ u4);
+}
+
+
+static void viterbi(const float *soft, unsigned char *u) {
+
+	static const float NEG = -1e30;
+
+	unsigned int k, s, b, n, o;
+	float metric[16], next[16], m;
+	unsigned char from[CONV_LEN][16];
+
+	for(s = 0; s < 16; s++)
+		metric[s] = NEG;
+	metric[0] = 0.0;
+
+	for(k = 0; k < CONV_LEN; k++) {
+		for(s = 0; s < 16; s++)
+			next[s] = NEG;
+		for(s = 0; s < 16; s++) {
+			if(metric[s] <= NEG)
+				continue;
+			for(b = 0; b < 2; b++) {
+				o = conv_out(s, b);
+				m = metric[s] +
+				   ((o & 2)? -soft[2 * k] : soft[2 * k]) +
+				   ((o & 1)? -soft[2 * k + 1] : soft[2 * k + 1]);
+				n = (b << 3) | (s >> 1);
+				if(m > next[n]) {
+					next[n] = m;
+					from[k][n] = s;
+				}
+			}
+		}
+		for(s = 0; s < 16; s++)
+			metric[s] = next[s];
+	}
+
+	// trace back from state 0
+	for(s = 0, k = CONV_LEN; k > 0; k--) {
+		u[k - 1] = (s >> 3) & 1;
+		s = from[k - 1][s];
+	}
+}
+
+
+/*
+ * The parity bits are the ones' complement of the remainder, so the
+ * remainder of the whole word is all ones.
+ */
+static int parity_check(const unsigned char *u) {
+
+	unsigned int i, r = 0;
+
+	for(i = 0; i < INFO_LEN + PARITY_LEN; i++) {
+		r = (r << 1) | u[i];
+		if(r & (1 << PARITY_LEN))
+			r ^= PARITY_POLY;
+	}
+
+	return (r == (1 << PARITY_LEN) - 1)? 0 : -1;
+}
+
+
+/*
+ * Searches +/- search samples around center for an SCH, demodulates and
+ * decodes it.  offset is the carrier offset in Hz as measured on the FCCH.
+ * Returns 0 and the burst start, BSIC and frame number on success.
+ */
+int sch_decoder::decode(const complex *s, const unsigned int s_len, const float center, const unsigned int search, const float offset, float *start, int *bsic, unsigned int *fn) {
+
+	unsigned int t1, t2, t3;
+	float p, best_p = -1.0, c, best_c = 0.0, soft[2 * DATA_LEN];
+	unsigned char u[CONV_LEN];
+	complex phase, best_phase;
+	profile_timer pt(PROF_SCH, s_len);
+
+	for(p = center - search; p <= center + search; p += 0.5) {
+		if((c = correlate(s, s_len, p, offset, &phase)) > best_c) {
+			best_c = c;
+			best_p = p;
+			best_phase = phase;
+		}
+	}
+
+	if(g_debug) {
+		printf("debug: sch: correlation %.2f at %.1f (expected %.1f)\n",
+		   best_c, best_p, center);
+	}
+
+	if(best_c < MIN_CORRELATION)
+		return -1;
+
+	if(demod(s, s_len, best_p, offset, best_phase, soft))
+		return -1;
+	viterbi(soft, u);
+	if(parity_check(u))
+		return -1;
+
+	if(bsic)
+		*bsic = (u[7] << 5) | (u[6] << 4) | (u[5] << 3) | (u[4] << 2) |
+		   (u[3] << 1) | u[2];
+
+	t1 = (u[1] << 10) | (u[0] << 9) | (u[15] << 8) | (u[14] << 7) |
+	   (u[13] << 6) | (u[12] << 5) | (u[11] << 4) | (u[10] << 3) |
+	   (u[9] << 2) | (u[8] << 1) | u[23];
+	t2 = (u[22] << 4) | (u[21] << 3) | (u[20] << 2) | (u[19] << 1) | u[18];
+	t3 = 10 * ((u[24] << 2) | (u[17] << 1) | u[16]) + 1;
+	if(fn)
+		*fn = 51 * 26 * t1 + 51 * ((t3 + 26 - t2) % 26) + t3;
+	if(start)
+		*start = best_p;
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sch_decoder
+ *
+ * Decodes the synchronization burst that follows every FCCH burst on C0.  The
+ * SCH carries the BSIC and the reduced frame number, which together with the
+ * sample position of the burst tell us exactly where every later FCCH burst
+ * in the 51-multiframe will be.
+ *
+ * The burst is demodulated coherently, treating GMSK as MSK: after removing
+ * the carrier offset and the pi/2 per symbol rotation, each symbol is +/-1
+ * times a common phase.  That phase and the burst timing come from the
+ * correlation against the 64-bit extended training sequence.
+ */
+
+#pragma once
+
+#include "usrp_complex.h"
+
+class sch_decoder {
+public:
+	sch_decoder(const float sample_rate);
+	~sch_decoder();
+
+	int decode(const complex *s, const unsigned int s_len, const float center, const unsigned int search, const float offset, float *start, int *bsic, unsigned int *fn);
+
+	static const unsigned int BURST_LEN		= 148;
+	static const unsigned int FRAME_LEN		= 1250;	// 8 * 156.25
+	static const unsigned int MULTIFRAME_LEN	= 51;
+
+	static unsigned int next_fcch_fn(const unsigned int fn);
+
+private:
+	float correlate(const complex *s, const unsigned int s_len, const float start, const float offset, complex *phase);
+	int demod(const complex *s, const unsigned int s_len, const float start, const float offset, const complex phase, float *soft);
+
+	float		m_sample_rate,
+			m_sps;
+};
@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "usrp_source.h"
+#include "fcch_detector.h"
+#include "sch_decoder.h"
+#include "arfcn_freq.h"
+#include "offset.h"
+#include "c0_detect.h"
+#include "gain.h"
+#include "server.h"
+
+extern int g_verbosity;
+
+
+struct server_client {
+	int		id,
+			fd,
+			pending,	// queued requests not yet answered
+			eof;		// no more requests, close once answered
+	std::string	buf,
+			out;		// answers it hasn't taken yet
+};
+
+
+struct server_request {
+	int		id;
+	std::string	line;
+};
+
+
+struct server {
+	usrp_source *			u;
+	fcch_detector *			l;
+	sch_decoder *			sch;
+	c0_cache *			cache;
+	float				precision,
+					confidence,
+					gain;
+	unsigned int			bursts;
+	int				agc,
+					window,
+					next_id,
+					done;
+	std::vector<server_client>	clients;
+	std::deque<server_request>	queue;
+	std::string			last_offset,
+					last_scan;
+};
+
+static const unsigned int	LINE_MAX_LEN	= 1024;
+static const int		FOUND_MAX	= 1024;
+static const size_t		OUT_MAX		= 1 << 20;
+
+
+static std::string failure(const char *request, const char *msg) {
+
+	char buf[BUFSIZ];
+
+	snprintf(buf, sizeof(buf), "{\"status\": \"error\", \"request\": "
+	   "\"%s\", \"error\": \"%s\"}", request, msg);
+
+	return buf;
+}
+
+
+static std::string do_offset(server *sv, char *arg, char *band) {
+
+	char buf[BUFSIZ];
+	int chan, bi = BI_NOT_DEFINED, r;
+	double v, freq;
+	offset_result res;
+
+	if(!arg)
+		return failure("offset", "channel or frequency required");
+	v = strtod(arg, 0);
+	if(v >= 1e6) {
+		// the bounds kal puts on -f
+		if((v < 869e6) || (2e9 < v))
+			return failure("offset", "bad frequency");
+		freq = v;
+		chan = freq_to_arfcn(freq, &bi);
+	} else {
+		chan = (int)v;
+		if(band && ((bi = str_to_bi(band)) == -1))
+			return failure("offset", "bad band");
+		if((freq = arfcn_to_freq(chan, &bi)) < 0.0)
+			return failure("offset", "bad channel");
+	}
+
+	if(!sv->u->tune(freq))
+		return failure("offset", "tune failed");
+	if(sv->agc) {
+		sv->u->start();
+		r = gain_range(sv->u, &sv->gain);
+		sv->u->stop();
+		if(r)
+			return failure("offset", "gain ranging failed");
+	}
+	if(offset_measure(sv->u, sv->l, sv->sch, sv->precision,
+	   sv->confidence, sv->window, sv->bursts, &res))
+		return failure("offset", "measurement failed");
+	if(!res.count)
+		return failure("offset", "no FCCH found");
+
+	snprintf(buf, sizeof(buf), "{\"status\": \"ok\", \"request\": "
+	   "\"offset\", \"time\": %ld, \"chan\": %d, \"band\": \"%s\", "
+	   "\"freq\": %.0lf, \"offset\": %.2f, \"ppm\": %.4lf, \"stddev\": "
+	   "%.2f, \"min\": %.2f, \"max\": %.2f, \"count\": %u, \"not_found\": "
+	   "%d, \"overruns\": %u}", (long)time(0), chan, bi_to_str(bi), freq,
+	   res.offset, 1e6 * res.offset / freq, res.stddev, res.min, res.max,
+	   res.count, res.notfound, res.overruns);
+	sv->last_offset = buf;
+
+	return buf;
+}
+
+
+static std::string do_scan(server *sv, char *arg) {
+
+	char buf[BUFSIZ];
+	int bands[BI_COUNT], band_count, n, i;
+	c0_result *found;
+	std::string r;
+
+	if((!arg) || ((band_count = str_to_bi_list(arg, bands, BI_COUNT)) < 0))
+		return failure("scan", "bad band");
+
+	found = new c0_result[FOUND_MAX];
+	if((n = c0_scan(&sv->u, 1, sv->l, bands, band_count, sv->cache, 0,
+	   found, FOUND_MAX, sv->agc, sv->gain)) < 0) {
+		delete[] found;
+		return failure("scan", "scan failed");
+	}
+	if(n > FOUND_MAX)
+		n = FOUND_MAX;
+
+	snprintf(buf, sizeof(buf), "{\"status\": \"ok\", \"request\": \"scan\", "
+	   "\"time\": %ld, \"bands\": [", (long)time(0));
+	r = buf;
+	for(i = 0; i < band_count; i++) {
+		snprintf(buf, sizeof(buf), "%s\"%s\"", i? ", " : "",
+		   bi_to_str(bands[i]));
+		r += buf;
+	}
+	r += "], \"carriers\": [";
+	for(i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "%s{\"chan\": %d, \"band\": \"%s\", "
+		   "\"freq\": %.0lf, \"offset\": %.2f, \"power\": %.2lf}",
+		   i? ", " : "", found[i].chan, bi_to_str(found[i].bi),
+		   found[i].freq, found[i].offset, found[i].power);
+		r += buf;
+	}
+	r += "]}";
+	delete[] found;
+	sv->last_scan = r;
+
+	return r;
+}
+
+
+static std::string execute(server *sv, const std::string &line) {
+
+	char buf[LINE_MAX_LEN + 1], *cmd, *arg, *arg2, *save;
+
+	strncpy(buf, line.c_str(), LINE_MAX_LEN);
+	buf[LINE_MAX_LEN] = 0;
+	if(!(cmd = strtok_r(buf, " \t", &save)))
+		return failure("", "empty request");
+	arg = strtok_r(0, " \t", &save);
+	arg2 = strtok_r(0, " \t", &save);
+
+	if(!strcmp(cmd, "offset"))
+		return do_offset(sv, arg, arg2);
+	if(!strcmp(cmd, "scan"))
+		return do_scan(sv, arg);
+	if(!strcmp(cmd, "last")) {
+		return std::string("{\"status\": \"ok\", \"request\": \"last\", "
+		   "\"offset\": ") + (sv->last_offset.empty()? "null" :
+		   sv->last_offset) + ", \"scan\": " + (sv->last_scan.empty()?
+		   "null" : sv->last_scan) + "}";
+	}
+	if(!strcmp(cmd, "shutdown")) {
+		sv->done = 1;
+		return "{\"status\": \"ok\", \"request\": \"shutdown\"}";
+	}
+
+	return failure("", "unknown request");
+}
+
+
+/*
+ * Writes as much of what is waiting for client c as it takes without
+ * blocking.  Returns -1 if the client has gone, or has left more than
+ * OUT_MAX unread while the device is being held for everyone.
+ */
+static int flush(server_client *c) {
+
+	ssize_t n;
+
+	while(!c->out.empty()) {
+		if((n = write(c->fd, c->out.data(), c->out.size())) < 0) {
+			if(errno == EINTR)
+				continue;
+			if((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				break;
+			return -1;
+		}
+		c->out.erase(0, n);
+	}
+
+	return (c->out.size() > OUT_MAX)? -1 : 0;
+}
+
+
+/*
+ * Whether client c has said all it will and been answered.
+ */
+static bool finished(const server_client *c) {
+
+	return c->eof && (!c->pending) && c->out.empty();
+}
+
+
+static void drop(server *sv, unsigned int i) {
+
+	close(sv->clients[i].fd);
+	sv->clients.erase(sv->clients.begin() + i);
+}
+
+
+/*
+ * Reads what client i has sent and queues each complete line.
+ */
+static void receive(server *sv, unsigned int i) {
+
+	char buf[BUFSIZ];
+	ssize_t n;
+	size_t e;
+	server_client *c = &sv->clients[i];
+	server_request req;
+
+	if((n = read(c->fd, buf, sizeof(buf))) <= 0) {
+		if((n < 0) && ((errno == EINTR) || (errno == EAGAIN) ||
+		   (errno == EWOULDBLOCK)))
+			return;
+		c->eof = 1;
+		if(finished(c))
+			drop(sv, i);
+		return;
+	}
+	c->buf.append(buf, n);
+
+	while((e = c->buf.find('\n')) != std::string::npos) {
+		req.id = c->id;
+		req.line = c->buf.substr(0, e);
+		c->buf.erase(0, e + 1);
+		if((!req.line.empty()) && (req.line[req.line.size() - 1] == '\r'))
+			req.line.erase(req.line.size() - 1);
+		if(req.line.empty())
+			continue;
+		sv->queue.push_back(req);
+		c->pending++;
+	}
+	if(c->buf.size() > LINE_MAX_LEN) {
+		fprintf(stderr, "warning: server: request too long\n");
+		c->eof = 1;
+		c->buf.clear();
+		if(finished(c))
+			drop(sv, i);
+	}
+}
+
+
+/*
+ * Runs the oldest queued request and answers the client that sent it, if
+ * it is still there.  What the client doesn't take at once is written as
+ * it reads.
+ */
+static void run_next(server *sv) {
+
+	server_request req = sv->queue.front();
+	std::string r;
+	unsigned int i;
+
+	sv->queue.pop_front();
+	for(i = 0; (i < sv->clients.size()) && (sv->clients[i].id != req.id);
+	   i++);
+	if(i == sv->clients.size())
+		return;
+
+	if(g_verbosity > 0) {
+		fprintf(stderr, "server: %s\n", req.line.c_str());
+	}
+	r = execute(sv, req.line) + "\n";
+
+	// the client may have come and gone while we were measuring
+	for(i = 0; (i < sv->clients.size()) && (sv->clients[i].id != req.id);
+	   i++);
+	if(i == sv->clients.size())
+		return;
+	sv->clients[i].pending--;
+	sv->clients[i].out += r;
+	if(flush(&sv->clients[i]) || finished(&sv->clients[i]))
+		drop(sv, i);
+}
+
+
+/*
+ * Removes the socket left at path by an earlier server, or by this one.
+ * Anything else there is left alone and -1 returned.
+ */
+static int remove_socket(const char *path) {
+
+	struct stat st;
+
+	if(lstat(path, &st))
+		return (errno == ENOENT)? 0 : -1;
+	if(!S_ISSOCK(st.st_mode)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	return unlink(path);
+}
+
+
+/*
+ * Serves requests on the Unix domain socket at path until asked to shut
+ * down.
+ */
+int server_run(usrp_source *u, const char *path, float precision,
+   float confidence, int track, int window, unsigned int bursts,
+   c0_cache *cache, int agc, float gain) {
+
+	struct sockaddr_un sa;
+	std::vector<struct pollfd> pfd;
+	server_client c;
+	unsigned int i;
+	int s, fd;
+	server sv;
+
+	if(strlen(path) >= sizeof(sa.sun_path)) {
+		fprintf(stderr, "error: server: socket path too long\n");
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+
+	if((s = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+	if(remove_socket(path) || bind(s, (struct sockaddr *)&sa, sizeof(sa)) ||
+	   listen(s, 16)) {
+		fprintf(stderr, "error: server: %s: %s\n", path, strerror(errno));
+		close(s);
+		return -1;
+	}
+
+	// a client going away mid-answer is not our problem
+	signal(SIGPIPE, SIG_IGN);
+
+	sv.u = u;
+	sv.l = new fcch_detector(u->sample_rate());
+	sv.sch = (track || window)? new sch_decoder(u->sample_rate()) : 0;
+	sv.cache = cache;
+	sv.precision = precision;
+	sv.confidence = confidence;
+	sv.window = window;
+	sv.bursts = bursts;
+	sv.agc = agc;
+	sv.gain = gain;
+	sv.next_id = 0;
+	sv.done = 0;
+
+	fprintf(stderr, "listening on %s\n", path);
+
+	while(!sv.done) {
+
+		// see who has something to say, without waiting if work is queued
+		pfd.resize(1);
+		pfd[0].fd = s;
+		pfd[0].events = POLLIN;
+		for(i = 0; i < sv.clients.size(); i++) {
+			struct pollfd p;
+			p.fd = sv.clients[i].fd;
+			p.events = (sv.clients[i].eof? 0 : POLLIN) |
+			   (sv.clients[i].out.empty()? 0 : POLLOUT);
+			if(!p.events)
+				p.fd = -1;
+			pfd.push_back(p);
+		}
+		if(poll(&pfd[0], pfd.size(), sv.queue.empty()? -1 : 0) < 0) {
+			if(errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		// serve clients in reverse so dropping one leaves the rest in place
+		for(i = pfd.size() - 1; i > 0; i--) {
+			if(!pfd[i].revents)
+				continue;
+			if((!sv.clients[i - 1].out.empty()) &&
+			   (flush(&sv.clients[i - 1]) ||
+			   finished(&sv.clients[i - 1]))) {
+				drop(&sv, i - 1);
+				continue;
+			}
+			if((!sv.clients[i - 1].eof) &&
+			   (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				receive(&sv, i - 1);
+		}
+
+		if(pfd[0].revents & POLLIN) {
+			if((fd = accept(s, 0, 0)) >= 0) {
+				// a client that doesn't read mustn't stall the rest
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				c.id = sv.next_id++;
+				c.fd = fd;
+				c.pending = 0;
+				c.eof = 0;
+				sv.clients.push_back(c);
+			}
+		}
+
+		if(!sv.queue.empty())
+			run_next(&sv);
+	}
+
+	for(i = 0; i < sv.clients.size(); i++)
+		close(sv.clients[i].fd);
+	close(s);
+	remove_socket(path);
+	delete sv.sch;
+	delete sv.l;
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * server
+ *
+ * Keeps the device open and the detectors warm between calibrations and
+ * takes requests on a Unix domain socket, one per line:
+ *
+ *	offset <chan> [<band>]	measure the offset on a channel
+ *	offset <freq>		or on a frequency in Hz
+ *	scan <bands>		look for C0 carriers, bands as for -s
+ *	last			the last offset and scan results
+ *	shutdown		answer, then exit
+ *
+ * Each request is answered with one line of JSON.  Requests from every
+ * client are queued in the order they arrive and run back to back.  The
+ * precision, tracking, cache and gain options kal was started with apply
+ * to every request; with -g auto the gain is ranged on each channel
+ * measured, starting from where the last request left it.
+ */
+
+#pragma once
+
+class usrp_source;
+class c0_cache;
+
+int server_run(usrp_source *u, const char *path, float precision,
+   float confidence, int track, int window, unsigned int bursts,
+   c0_cache *cache, int agc, float gain);
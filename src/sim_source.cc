@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim_source.h"
+#include "arfcn_freq.h"
+#include "profile.h"
+#include "gain.h"
+
+extern int g_verbosity;
+
+
+sim_source::sim_source(float sample_rate, const std::string args) :
+   usrp_source(sample_rate, 0, false, args) {
+
+	char buf[BUFSIZ], *tok, *val, *chan, *save, *csave;
+	int bi = BI_NOT_DEFINED, n, cbi;
+	double freq;
+
+	m_offset = 0.0;
+	m_snr = 30.0;
+	m_level = 0.0;
+	m_gain = GAIN_DEFAULT;
+	m_bsic = -1;
+	m_index = 0;
+	m_synth = 0;
+	m_device_rate = sample_rate;
+
+	strncpy(buf, args.c_str(), sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+
+	// band first so the channel list can be resolved
+	for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(0, ",", &save)) {
+		if(!(val = strchr(tok, '=')))
+			continue;
+		*val++ = 0;
+		if(!strcmp(tok, "band"))
+			bi = str_to_bi(val);
+	}
+
+	strncpy(buf, args.c_str(), sizeof(buf) - 1);
+	for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(0, ",", &save)) {
+		if(!(val = strchr(tok, '=')))
+			continue;
+		*val++ = 0;
+		if(!strcmp(tok, "offset"))
+			m_offset = strtod(val, 0);
+		else if(!strcmp(tok, "snr"))
+			m_snr = strtod(val, 0);
+		else if(!strcmp(tok, "level"))
+			m_level = strtod(val, 0);
+		else if(!strcmp(tok, "rate"))
+			m_device_rate = strtod(val, 0);
+		else if(!strcmp(tok, "bsic"))
+			m_bsic = strtol(val, 0, 0);
+		else if(!strcmp(tok, "chan")) {
+			for(chan = strtok_r(val, "/", &csave); chan;
+			   chan = strtok_r(0, "/", &csave)) {
+				n = strtol(chan, 0, 0);
+				if((512 <= n) && (n <= 810) && (bi == BI_NOT_DEFINED)) {
+					cbi = DCS_1800;
+					m_freqs.push_back(arfcn_to_freq(n, &cbi));
+					cbi = PCS_1900;
+					m_freqs.push_back(arfcn_to_freq(n, &cbi));
+					continue;
+				}
+				cbi = bi;
+				if((freq = arfcn_to_freq(n, &cbi)) > 0.0)
+					m_freqs.push_back(freq);
+			}
+		}
+	}
+}
+
+
+sim_source::~sim_source() {
+
+	delete m_synth;
+}
+
+
+int sim_source::open(unsigned int subdev) {
+
+	if(!m_synth) {
+		m_synth = new gsm_synth(m_device_rate, m_offset, m_snr,
+		   amplitude(), (m_bsic < 0)? 0 : m_bsic);
+		resample_setup();
+		if(g_verbosity > 1) {
+			fprintf(stderr, "Sample rate: %f\n", m_sample_rate);
+		}
+	}
+	m_recv_samples_per_packet = PACKET_LEN;
+
+	return 0;
+}
+
+
+/*
+ * Carrier amplitude at the current gain, 1000 at the default gain and level.
+ */
+float sim_source::amplitude() {
+
+	return 1000.0 * pow(10.0, (m_level + (m_gain - GAIN_DEFAULT) *
+	   GAIN_RANGE) / 20.0);
+}
+
+
+static inline float clip(float x, float limit) {
+
+	return (x > limit)? limit : ((x < -limit)? -limit : x);
+}
+
+
+void sim_source::generate(unsigned int len) {
+
+	unsigned int i;
+	complex *c;
+
+	c = input_buffer(&len);
+	m_synth->generate(c, len, m_index);
+	for(i = 0; i < len; i++) {
+		c[i] = complex(clip(c[i].real(), FULL_SCALE),
+		   clip(c[i].imag(), FULL_SCALE));
+	}
+	commit(len, true, m_index / (double)m_device_rate);
+	m_index += len;
+}
+
+
+int sim_source::fill(unsigned int num_samples, unsigned int *overrun) {
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	while((m_cb->data_available() < num_samples) &&
+	   (m_cb->space_available() > 0))
+		generate(PACKET_LEN);
+
+	if(overrun)
+		*overrun = 0;
+
+	return 0;
+}
+
+
+int sim_source::capture(double when, unsigned int num_samples, unsigned int *overrun) {
+
+	unsigned long long start;
+	unsigned int len, num_device;
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	if(overrun)
+		*overrun = 0;
+
+	m_streaming = false;
+	if(m_cb->space_available() < num_samples) {
+		fprintf(stderr, "error: sim_source::capture: no space\n");
+		return -1;
+	}
+
+	num_device = device_samples(num_samples, &when);
+	start = (unsigned long long)ceil(when * m_device_rate);
+	if(start < m_index)
+		return 1;
+
+	m_index = start;
+	while(num_device) {
+		len = (num_device < PACKET_LEN)? num_device : PACKET_LEN;
+		generate(len);
+		num_device -= len;
+	}
+
+	return 0;
+}
+
+
+int sim_source::tune(double freq) {
+
+	unsigned int i;
+	bool on = m_freqs.empty();
+	profile_timer pt(PROF_TUNE);
+
+	for(i = 0; (!on) && (i < m_freqs.size()); i++)
+		on = (fabs(m_freqs[i] - freq) < 1.0);
+	m_synth->set_carrier(on);
+
+	// a BTS per channel, so give each its own BSIC unless one was chosen
+	if(m_bsic < 0)
+		m_synth->set_bsic((int)(freq / 200e3) % 64);
+
+	return (int)freq;
+}
+
+
+void sim_source::set_antenna(int antenna) {
+
+}
+
+
+void sim_source::set_antenna(const std::string antenna) {
+
+}
+
+
+std::vector<std::string> sim_source::get_antennas() {
+
+	return std::vector<std::string>(1, "RX2");
+}
+
+
+bool sim_source::set_gain(float gain) {
+
+	if((gain < 0.0) || (1.0 < gain))
+		return false;
+	m_gain = gain;
+	if(m_synth)
+		m_synth->set_amplitude(amplitude());
+
+	return true;
+}
+
+
+void sim_source::start() {
+
+	m_streaming = true;
+}
+
+
+void sim_source::stop() {
+
+	m_streaming = false;
+}
+
+
+double sim_source::time_now() {
+
+	return m_index / (double)m_device_rate;
+}
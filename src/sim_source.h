@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * sim_source
+ *
+ * A stand-in for the USRP that synthesizes a GSM carrier with gsm_synth.
+ * Selected with device arguments starting with "sim", for example
+ *
+ *	sim,offset=1500,snr=20,chan=128/135/190,band=PCS
+ *
+ * offset is the carrier offset in Hz, snr is in dB, chan is a '/'-separated
+ * list of ARFCNs that carry a BTS (every channel does if it is omitted) and
+ * rate overrides the sample rate the device reports.  level raises the
+ * carrier by that many dB.  The gain spans GAIN_RANGE dB and samples clip
+ * at the sc16 full scale, as they would on hardware.
+ *
+ * The device clock is the sample count, so it only advances as samples are
+ * produced.  Timed captures jump the clock forward to the requested time and
+ * late captures fail the way they would on hardware.
+ */
+
+#pragma once
+
+#include "usrp_source.h"
+#include "gsm_synth.h"
+
+class sim_source : public usrp_source {
+public:
+	sim_source(float sample_rate, const std::string args);
+	~sim_source();
+
+	int open(unsigned int subdev);
+	int fill(unsigned int num_samples, unsigned int *overrun);
+	int capture(double when, unsigned int num_samples, unsigned int *overrun);
+	int tune(double freq);
+	void set_antenna(int antenna);
+	void set_antenna(const std::string antenna);
+	std::vector<std::string> get_antennas();
+	bool set_gain(float gain);
+	void start();
+	void stop();
+	double time_now();
+
+private:
+	void generate(unsigned int len);
+	float amplitude();
+
+	gsm_synth *			m_synth;
+	unsigned long long		m_index;
+	float				m_offset,
+					m_snr,
+					m_level,
+					m_gain;
+	int				m_bsic;
+	std::vector<double>		m_freqs;
+
+	static const unsigned int	PACKET_LEN	= 1000;
+	static const float		GAIN_RANGE	= 70.0;	// dB
+	static const float		FULL_SCALE	= 32767.0;
+};
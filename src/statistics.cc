@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <algorithm>
+
+#include "statistics.h"
+
+
+/*
+ * Partitions b so that b[trim] and b[len - trim - 1] are in their sorted
+ * positions with everything smaller before and everything larger after.
+ */
+static void partition_trim(float *b, unsigned int len, unsigned int trim) {
+
+	std::nth_element(b, b + trim, b + len);
+	if(len - trim - 1 > trim)
+		std::nth_element(b + trim + 1, b + len - trim - 1, b + len);
+}
+
+
+/*
+ * Mean of b with the trim smallest and trim largest values removed.  b is
+ * reordered.  min and max are the smallest and largest values kept.
+ */
+double trimmed_mean(float *b, unsigned int len, unsigned int trim, float *stddev, float *min, float *max) {
+
+	unsigned int i;
+	welford w;
+
+	if((!len) || (2 * trim >= len))
+		return 0.0;
+
+	partition_trim(b, len, trim);
+	for(i = trim; i < len - trim; i++)
+		w.add(b[i]);
+
+	if(stddev)
+		*stddev = w.stddev();
+	if(min)
+		*min = b[trim];
+	if(max)
+		*max = b[len - trim - 1];
+
+	return w.mean();
+}
+
+
+/*
+ * Inverse of the standard normal CDF by bisection on erfc.  Only used for a
+ * handful of values per measurement so speed doesn't matter.
+ */
+static double norm_quantile(double p) {
+
+	double lo = -10.0, hi = 10.0, mid = 0.0;
+
+	for(int i = 0; i < 64; i++) {
+		mid = (lo + hi) / 2.0;
+		if(0.5 * erfc(-mid / M_SQRT2) < p)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return mid;
+}
+
+
+/*
+ * Student's t CDF for df from 1 to 4, where it has a closed form.
+ */
+static double t_cdf_small(double x, unsigned int df) {
+
+	double u;
+
+	switch(df) {
+	case 1:
+		return 0.5 + atan(x) / M_PI;
+	case 2:
+		return 0.5 + x / (2.0 * sqrt(2.0 + x * x));
+	case 3:
+		u = x / sqrt(3.0);
+		return 0.5 + (u / (1.0 + u * u) + atan(u)) / M_PI;
+	default:
+		u = 1.0 + x * x / 4.0;
+		return 0.5 + 0.375 * x / sqrt(u) * (1.0 - x * x / (12.0 * u));
+	}
+}
+
+
+/*
+ * Student's t quantile using the Cornish-Fisher expansion about the normal
+ * quantile, which is good to a few parts in 1e3 for df >= 5.  Below that
+ * it is far off, so the exact CDF is inverted by bisection instead.
+ */
+static double t_quantile(double p, unsigned int df) {
+
+	double lo = -1e4, hi = 1e4, mid = 0.0, z, z3, z5, z7, n = df;
+
+	if(df < 5) {
+		for(int i = 0; i < 64; i++) {
+			mid = (lo + hi) / 2.0;
+			if(t_cdf_small(mid, df) < p)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		return mid;
+	}
+
+	z = norm_quantile(p);
+	z3 = z * z * z;
+	z5 = z3 * z * z;
+	z7 = z5 * z * z;
+
+	return z + (z3 + z) / (4.0 * n) +
+	   (5.0 * z5 + 16.0 * z3 + 3.0 * z) / (96.0 * n * n) +
+	   (3.0 * z7 + 19.0 * z5 + 17.0 * z3 - 15.0 * z) / (384.0 * n * n * n);
+}
+
+
+/*
+ * Half-width of the confidence interval of the trimmed mean of b
+ * (Tukey-McLaughlin, using the winsorized variance).  trim values are
+ * removed from each end and b is reordered.  Returns a negative value if len
+ * is too small to say anything.
+ */
+double trimmed_ci(float *b, unsigned int len, unsigned int trim, float confidence, double *mean) {
+
+	unsigned int i, h;
+	float lo, hi;
+	double t;
+	welford w;
+
+	if(2 * trim + 2 > len)
+		return -1.0;
+	h = len - 2 * trim;
+
+	t = trimmed_mean(b, len, trim, 0, &lo, &hi);
+	if(mean)
+		*mean = t;
+
+	// winsorized variance
+	for(i = 0; i < len; i++)
+		w.add((i < trim)? lo : ((i >= len - trim)? hi : b[i]));
+
+	return t_quantile(0.5 + confidence / 2.0, h - 1) *
+	   sqrt(w.variance() * len / (len - 1)) /
+	   ((1.0 - 2.0 * trim / (double)len) * sqrt((double)len));
+}
+
+
+welford::welford() {
+
+	reset();
+}
+
+
+void welford::reset() {
+
+	m_n = 0;
+	m_mean = m_m2 = 0.0;
+}
+
+
+void welford::add(const double x) {
+
+	double d;
+
+	m_n += 1;
+	d = x - m_mean;
+	m_mean += d / m_n;
+	m_m2 += d * (x - m_mean);
+}
+
+
+unsigned long welford::count() {
+
+	return m_n;
+}
+
+
+double welford::mean() {
+
+	return m_mean;
+}
+
+
+/*
+ * Population variance, to match what avg() used to return.
+ */
+double welford::variance() {
+
+	return m_n? m_m2 / m_n : 0.0;
+}
+
+
+double welford::stddev() {
+
+	return sqrt(variance());
+}
+
+
+p2_quantile::p2_quantile(const double p) {
+
+	m_p = p;
+	m_count = 0;
+}
+
+
+void p2_quantile::add(const double x) {
+
+	int i, k, s;
+	double d, qp;
+
+	// collect the first five values as the initial markers
+	if(m_count < 5) {
+		m_q[m_count++] = x;
+		if(m_count == 5) {
+			std::sort(m_q, m_q + 5);
+			for(i = 0; i < 5; i++)
+				m_n[i] = i;
+			m_np[0] = 0.0;
+			m_np[1] = 2.0 * m_p;
+			m_np[2] = 4.0 * m_p;
+			m_np[3] = 2.0 + 2.0 * m_p;
+			m_np[4] = 4.0;
+			m_dn[0] = 0.0;
+			m_dn[1] = m_p / 2.0;
+			m_dn[2] = m_p;
+			m_dn[3] = (1.0 + m_p) / 2.0;
+			m_dn[4] = 1.0;
+		}
+		return;
+	}
+	m_count += 1;
+
+	// find the cell containing x and extend the extremes if necessary
+	if(x < m_q[0]) {
+		m_q[0] = x;
+		k = 0;
+	} else if(x >= m_q[4]) {
+		m_q[4] = x;
+		k = 3;
+	} else {
+		for(k = 0; k < 3; k++)
+			if(x < m_q[k + 1])
+				break;
+	}
+
+	for(i = k + 1; i < 5; i++)
+		m_n[i] += 1;
+	for(i = 0; i < 5; i++)
+		m_np[i] += m_dn[i];
+
+	// adjust the middle markers
+	for(i = 1; i < 4; i++) {
+		d = m_np[i] - m_n[i];
+		if(((d >= 1.0) && (m_n[i + 1] - m_n[i] > 1)) ||
+		   ((d <= -1.0) && (m_n[i - 1] - m_n[i] < -1))) {
+			s = (d >= 0.0)? 1 : -1;
+
+			// piecewise-parabolic prediction
+			qp = m_q[i] + (double)s / (m_n[i + 1] - m_n[i - 1]) *
+			   ((m_n[i] - m_n[i - 1] + s) * (m_q[i + 1] - m_q[i]) /
+			   (m_n[i + 1] - m_n[i]) +
+			   (m_n[i + 1] - m_n[i] - s) * (m_q[i] - m_q[i - 1]) /
+			   (m_n[i] - m_n[i - 1]));
+
+			// fall back to linear if it isn't monotonic
+			if((qp <= m_q[i - 1]) || (m_q[i + 1] <= qp))
+				qp = m_q[i] + s * (m_q[i + s] - m_q[i]) /
+				   (m_n[i + s] - m_n[i]);
+
+			m_q[i] = qp;
+			m_n[i] += s;
+		}
+	}
+}
+
+
+unsigned long p2_quantile::count() {
+
+	return m_count;
+}
+
+
+double p2_quantile::value() {
+
+	double b[5];
+	unsigned int i;
+
+	if(m_count >= 5)
+		return m_q[2];
+	if(!m_count)
+		return 0.0;
+
+	// not enough for markers yet, use the exact quantile
+	for(i = 0; i < m_count; i++)
+		b[i] = m_q[i];
+	std::sort(b, b + m_count);
+	i = (unsigned int)(m_p * (m_count - 1) + 0.5);
+	return b[i];
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * statistics
+ *
+ * Order statistics are done with selection rather than sorting so they are
+ * O(n).  welford and p2_quantile are streaming estimators that use constant
+ * memory regardless of how many values they are fed.
+ */
+
+#pragma once
+
+double trimmed_mean(float *b, unsigned int len, unsigned int trim, float *stddev = 0, float *min = 0, float *max = 0);
+double trimmed_ci(float *b, unsigned int len, unsigned int trim, float confidence, double *mean);
+
+
+/*
+ * Welford's running mean and variance.
+ */
+class welford {
+public:
+	welford();
+
+	void add(const double x);
+	void reset();
+	unsigned long count();
+	double mean();
+	double variance();
+	double stddev();
+
+private:
+	unsigned long	m_n;
+	double		m_mean,
+			m_m2;
+};
+
+
+/*
+ * Jain and Chlamtac's P-square estimator for a single quantile.
+ */
+class p2_quantile {
+public:
+	p2_quantile(const double p);
+
+	void add(const double x);
+	unsigned long count();
+	double value();
+
+private:
+	double		m_p,
+			m_q[5],
+			m_np[5],
+			m_dn[5];
+	long		m_n[5];
+	unsigned long	m_count;
+};
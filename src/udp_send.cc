@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * kal_udp_send
+ *
+ * Streams a gsm_synth carrier over UDP to a kal running with a udp=
+ * device, for exercising udp_source without a front-end.  Built with
+ * "make kal_udp_send" in src; not installed.  For example
+ *
+ *	kal_udp_send -p 5000 -f vita -F fc32 -d 100 -o 1234
+ *	kal -u udp=5000,framing=vita,format=fc32 -c 30 -b GSM900
+ *
+ * sends a carrier 1234 Hz off as VITA-49 packets of floats and leaves out
+ * every 100th data packet, so kal should measure 1234 Hz and report the
+ * gaps as overruns.  Samples go out in real time, paced by the sample
+ * count, with a VITA context packet every CONTEXT_EVERY data packets to
+ * check that they are skipped.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "usrp_complex.h"
+#include "gsm_synth.h"
+#include "util.h"
+
+static const unsigned int PKT_LEN = 9000;	// what udp_source receives
+static const unsigned int HDR_LEN = 8;
+static const unsigned int STREAM_ID = 42;
+static const unsigned int CONTEXT_EVERY = 50;
+
+enum framing_t { FRAMING_RAW, FRAMING_SEQ, FRAMING_VITA };
+
+
+static double now() {
+
+	struct timeval tv;
+
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ * Lays out one datagram of samples behind the header for framing.  VITA
+ * packets are an IF data packet with a stream id, everything in network
+ * byte order; the other framings are in host byte order.  Returns the
+ * length of the datagram.
+ */
+static unsigned int pack(unsigned char *buf, const complex *c,
+   const unsigned int len, const framing_t framing, const bool fc32,
+   const unsigned long long seq) {
+
+	unsigned int i, hdr = 0, size = fc32? 8 : 4, w[2];
+	short s[2];
+	float f[2];
+
+	if(framing == FRAMING_SEQ) {
+		memcpy(buf, &seq, sizeof(seq));
+		hdr = sizeof(seq);
+	} else if(framing == FRAMING_VITA) {
+		w[0] = htonl((1 << 28) | ((seq & 0xf) << 16) |
+		   (2 + len * size / 4));
+		w[1] = htonl(STREAM_ID);
+		memcpy(buf, w, 8);
+		hdr = 8;
+	}
+
+	for(i = 0; i < len; i++) {
+		if(fc32) {
+			f[0] = c[i].real();
+			f[1] = c[i].imag();
+			memcpy(w, f, sizeof(f));
+			if(framing == FRAMING_VITA) {
+				w[0] = htonl(w[0]);
+				w[1] = htonl(w[1]);
+			}
+			memcpy(buf + hdr + i * size, w, size);
+		} else {
+			s[0] = (short)c[i].real();
+			s[1] = (short)c[i].imag();
+			if(framing == FRAMING_VITA) {
+				s[0] = htons(s[0]);
+				s[1] = htons(s[1]);
+			}
+			memcpy(buf + hdr + i * size, s, size);
+		}
+	}
+
+	return hdr + len * size;
+}
+
+
+static void usage(char *prog) {
+
+	printf("Usage: %s [-a address] [-p port] [-f raw|seq|vita] "
+	   "[-F sc16|fc32] [-d drop every] [-o offset] [-s sample rate] "
+	   "[-n samples per datagram]\n", prog);
+	exit(-1);
+}
+
+
+int main(int argc, char **argv) {
+
+	int c, fd;
+	unsigned int len = 1000, drop = 0, n, ctx[3];
+	unsigned long long seq, index = 0;
+	bool fc32 = false;
+	float offset = 0.0;
+	double rate = GSM_RATE, start, due;
+	const char *addr = "127.0.0.1";
+	long port = 5000;
+	framing_t framing = FRAMING_RAW;
+	struct sockaddr_in sin;
+	unsigned char buf[PKT_LEN];
+	complex *samples;
+	gsm_synth *synth;
+
+	while((c = getopt(argc, argv, "a:p:f:F:d:o:s:n:h?")) != EOF) {
+		switch(c) {
+			case 'a':
+				addr = optarg;
+				break;
+
+			case 'p':
+				port = strtol(optarg, 0, 0);
+				if((port <= 0) || (port > 65535))
+					usage(argv[0]);
+				break;
+
+			case 'f':
+				if(!strcmp(optarg, "raw"))
+					framing = FRAMING_RAW;
+				else if(!strcmp(optarg, "seq"))
+					framing = FRAMING_SEQ;
+				else if(!strcmp(optarg, "vita"))
+					framing = FRAMING_VITA;
+				else
+					usage(argv[0]);
+				break;
+
+			case 'F':
+				if(!strcmp(optarg, "fc32"))
+					fc32 = true;
+				else if(!strcmp(optarg, "sc16"))
+					fc32 = false;
+				else
+					usage(argv[0]);
+				break;
+
+			case 'd':
+				drop = strtoul(optarg, 0, 0);
+				break;
+
+			case 'o':
+				offset = strtod(optarg, 0);
+				break;
+
+			case 's':
+				rate = strtod(optarg, 0);
+				if(rate <= 0.0)
+					usage(argv[0]);
+				break;
+
+			case 'n':
+				len = strtoul(optarg, 0, 0);
+				break;
+
+			default:
+				usage(argv[0]);
+				break;
+		}
+	}
+	if(!len || (HDR_LEN + len * (fc32? 8 : 4) > PKT_LEN)) {
+		fprintf(stderr, "error: at most %u samples per datagram\n",
+		   (PKT_LEN - HDR_LEN) / (fc32? 8 : 4));
+		return -1;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	if(inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+		fprintf(stderr, "error: bad address: ``%s''\n", addr);
+		return -1;
+	}
+	if((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	printf("sending to %s:%ld, %.2f samples/s, %u per datagram",
+	   addr, port, rate, len);
+	if(drop)
+		printf(", dropping every %u", drop);
+	printf("\n");
+
+	samples = new complex[len];
+	synth = new gsm_synth(rate, offset, 30.0, 1000.0, 5);
+	start = now();
+	for(seq = 0;; seq++) {
+		synth->generate(samples, len, index);
+		n = pack(buf, samples, len, framing, fc32, seq);
+		if(!(drop && (seq % drop == drop - 1)) && (sendto(fd, buf, n,
+		   0, (struct sockaddr *)&sin, sizeof(sin)) < 0)) {
+			if(errno != ECONNREFUSED) {
+				perror("sendto");
+				break;
+			}
+		}
+
+		// an empty context packet, which udp_source should skip
+		if((framing == FRAMING_VITA) && !(seq % CONTEXT_EVERY)) {
+			ctx[0] = htonl((4 << 28) | 3);
+			ctx[1] = htonl(STREAM_ID);
+			ctx[2] = 0;
+			sendto(fd, ctx, sizeof(ctx), 0,
+			   (struct sockaddr *)&sin, sizeof(sin));
+		}
+
+		index += len;
+		due = start + index / rate;
+		while(now() < due)
+			usleep(200);
+	}
+
+	delete synth;
+	delete[] samples;
+	close(fd);
+
+	return -1;
+}
@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* !_GNU_SOURCE */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "udp_source.h"
+#include "profile.h"
+
+extern int g_verbosity;
+
+#ifndef HAVE_RECVMMSG
+struct mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+#endif /* !HAVE_RECVMMSG */
+
+
+udp_source::udp_source(float sample_rate, const std::string args) :
+   usrp_source(sample_rate, 0, false, args) {
+
+	char buf[BUFSIZ], *tok, *val, *save, *port;
+
+	m_addr = "0.0.0.0";
+	m_port = -1;
+	m_format = FORMAT_SC16;
+	m_framing = FRAMING_RAW;
+	m_fd = -1;
+	m_index = 0;
+	m_seq = 0;
+	m_have_seq = false;
+	m_bad_args = false;
+	m_pkt = 0;
+	m_msgs = 0;
+	m_iovs = 0;
+	m_count = 0;
+	m_next = 0;
+	m_offset = 0;
+	m_device_rate = sample_rate;
+
+	strncpy(buf, args.c_str(), sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(0, ",", &save)) {
+		if(!(val = strchr(tok, '=')))
+			continue;
+		*val++ = 0;
+		if(!strcmp(tok, "udp")) {
+			if((port = strrchr(val, ':'))) {
+				*port++ = 0;
+				m_addr = val;
+			} else
+				port = val;
+			m_port = strtol(port, 0, 0);
+		} else if(!strcmp(tok, "rate"))
+			m_device_rate = strtod(val, 0);
+		else if(!strcmp(tok, "format")) {
+			if(!strcmp(val, "fc32"))
+				m_format = FORMAT_FC32;
+			else if(strcmp(val, "sc16")) {
+				fprintf(stderr, "error: udp_source: bad format: "
+				   "``%s''\n", val);
+				m_bad_args = true;
+			}
+		} else if(!strcmp(tok, "framing")) {
+			if(!strcmp(val, "seq"))
+				m_framing = FRAMING_SEQ;
+			else if(!strcmp(val, "vita"))
+				m_framing = FRAMING_VITA;
+			else if(strcmp(val, "raw")) {
+				fprintf(stderr, "error: udp_source: bad framing: "
+				   "``%s''\n", val);
+				m_bad_args = true;
+			}
+		}
+	}
+}
+
+
+udp_source::~udp_source() {
+
+	if(m_fd >= 0)
+		close(m_fd);
+	delete[] m_iovs;
+	delete[] m_msgs;
+	delete[] m_pkt;
+}
+
+
+int udp_source::open(unsigned int subdev) {
+
+	struct sockaddr_in sin;
+	unsigned int i;
+	int size = RCVBUF;
+
+	if(m_fd >= 0)
+		return 0;
+
+	// already reported by the constructor
+	if(m_bad_args)
+		return -1;
+
+	if((m_port <= 0) || (m_port > 65535)) {
+		fprintf(stderr, "error: udp_source: bad port\n");
+		return -1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(m_port);
+	if(inet_pton(AF_INET, m_addr.c_str(), &sin.sin_addr) != 1) {
+		fprintf(stderr, "error: udp_source: bad address: ``%s''\n",
+		   m_addr.c_str());
+		return -1;
+	}
+
+	if((m_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		fprintf(stderr, "error: udp_source: socket: %s\n",
+		   strerror(errno));
+		return -1;
+	}
+
+	// room for a burst while we're busy detecting
+	if(setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) &&
+	   (g_verbosity > 0)) {
+		fprintf(stderr, "udp_source: SO_RCVBUF: %s\n", strerror(errno));
+	}
+	if(bind(m_fd, (struct sockaddr *)&sin, sizeof(sin))) {
+		fprintf(stderr, "error: udp_source: bind %s:%d: %s\n",
+		   m_addr.c_str(), m_port, strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+		return -1;
+	}
+
+	m_pkt = new unsigned char[BATCH * PKT_LEN];
+	m_msgs = new struct mmsghdr[BATCH];
+	m_iovs = new struct iovec[BATCH];
+	memset(m_msgs, 0, BATCH * sizeof(*m_msgs));
+	for(i = 0; i < BATCH; i++) {
+		m_iovs[i].iov_base = m_pkt + i * PKT_LEN;
+		m_iovs[i].iov_len = PKT_LEN;
+		m_msgs[i].msg_hdr.msg_iov = &m_iovs[i];
+		m_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	resample_setup();
+	m_recv_samples_per_packet = PKT_LEN / (2 * sizeof(short));
+
+	if(g_verbosity > 1) {
+		fprintf(stderr, "Listening on udp %s:%d\n", m_addr.c_str(),
+		   m_port);
+		fprintf(stderr, "Sample rate: %f\n", m_sample_rate);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Receives as many datagrams as are waiting, up to BATCH, first waiting
+ * for one if wait is set.  Returns the number received, or -1 on error or
+ * if the sender has been quiet for IDLE_MAX seconds.
+ */
+int udp_source::receive(bool wait) {
+
+	struct pollfd pfd;
+	unsigned int i;
+	int n, r, idle = 0;
+
+	m_count = 0;
+	m_next = 0;
+	m_offset = 0;
+
+	while(wait) {
+		pfd.fd = m_fd;
+		pfd.events = POLLIN;
+		if((r = poll(&pfd, 1, 1000)) > 0)
+			break;
+		if((r < 0) && (errno != EINTR)) {
+			fprintf(stderr, "error: udp_source: poll: %s\n",
+			   strerror(errno));
+			return -1;
+		}
+		if((!r) && (++idle >= IDLE_MAX)) {
+			fprintf(stderr, "error: udp_source: nothing received "
+			   "for %d seconds\n", IDLE_MAX);
+			return -1;
+		}
+	}
+
+#ifdef HAVE_RECVMMSG
+	n = recvmmsg(m_fd, m_msgs, BATCH, MSG_DONTWAIT, 0);
+#else
+	for(n = 0; n < (int)BATCH; n++) {
+		if((r = recv(m_fd, m_iovs[n].iov_base, PKT_LEN, MSG_DONTWAIT)) < 0)
+			break;
+		m_msgs[n].msg_len = r;
+	}
+	if(!n)
+		n = -1;
+#endif /* HAVE_RECVMMSG */
+	if(n < 0) {
+		if((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+		   (errno == EINTR))
+			return 0;
+		fprintf(stderr, "error: udp_source: recv: %s\n",
+		   strerror(errno));
+		return -1;
+	}
+
+	for(i = 0; i < (unsigned int)n; i++)
+		parse(i);
+
+	return n;
+}
+
+
+/*
+ * Finds the samples in datagram i and, if there are any, adds them to the
+ * batch with how many went missing before them.  Returns -1 if there were
+ * none.
+ */
+int udp_source::parse(unsigned int i) {
+
+	unsigned char *p = m_pkt + i * PKT_LEN;
+	unsigned int len = m_msgs[i].msg_len, hdr = 0, samples, lost = 0, w;
+	unsigned long long seq = 0, gap;
+
+	if(m_framing == FRAMING_SEQ) {
+		if(len < sizeof(seq))
+			return -1;
+		memcpy(&seq, p, sizeof(seq));
+		hdr = sizeof(seq);
+	} else if(m_framing == FRAMING_VITA) {
+		if(len < 4)
+			return -1;
+		memcpy(&w, p, 4);
+		w = ntohl(w);
+
+		// IF and extension data, with or without a stream id
+		if((w >> 28) > 3)
+			return -1;
+		if((w & 0xffff) * 4 > len)
+			return -1;
+		len = (w & 0xffff) * 4;
+		hdr = 4 * (1 + ((w >> 28) & 1) + 2 * ((w >> 27) & 1) +
+		   (((w >> 22) & 3)? 1 : 0) + (((w >> 20) & 3)? 2 : 0));
+		if((w >> 26) & 1)
+			len -= 4;
+		if(hdr > len)
+			return -1;
+		seq = (w >> 16) & 0xf;
+	}
+
+	samples = (len - hdr) / ((m_format == FORMAT_FC32)? 8 : 4);
+	if(!samples)
+		return -1;
+
+	if(m_framing != FRAMING_RAW) {
+		gap = seq - m_seq;
+		if(m_framing == FRAMING_VITA)
+			gap &= 0xf;
+
+		// a sender that restarted counts from scratch
+		if(m_have_seq && (gap < (1ULL << 20)))
+			lost = gap * samples;
+		m_seq = seq + 1;
+		m_have_seq = true;
+	}
+
+	m_payload[m_count] = p + hdr;
+	m_samples[m_count] = samples;
+	m_lost[m_count] = lost;
+	m_count++;
+
+	return 0;
+}
+
+
+static void udp_convert(const unsigned char *p, complex *c, unsigned int len,
+   int format, bool network) {
+
+	const short *s = (const short *)p;
+	const unsigned int *f = (const unsigned int *)p;
+	unsigned int i, w[2];
+	float v[2];
+
+	if(format == udp_source::FORMAT_SC16) {
+		if(!network) {
+			sc16_to_fc32(s, c, len);
+			return;
+		}
+		for(i = 0; i < len; i++) {
+			c[i] = complex((short)ntohs(s[2 * i]),
+			   (short)ntohs(s[2 * i + 1]));
+		}
+		return;
+	}
+
+	if(!network) {
+		memcpy(c, p, len * sizeof(complex));
+		return;
+	}
+	for(i = 0; i < len; i++) {
+		w[0] = ntohl(f[2 * i]);
+		w[1] = ntohl(f[2 * i + 1]);
+		memcpy(v, w, sizeof(v));
+		c[i] = complex(v[0], v[1]);
+	}
+}
+
+
+/*
+ * Takes up to len samples from the datagrams received, in to the buffer
+ * if keep is set, receiving more as needed.  Samples lost before a
+ * datagram are skipped over and counted in gaps.  Returns the number
+ * taken, which is less than len if the buffer filled, or -1 on error.
+ */
+int udp_source::take(unsigned int len, bool keep, unsigned int *gaps) {
+
+	unsigned int taken = 0, n;
+	complex *c;
+
+	while(taken < len) {
+		if(m_next >= m_count) {
+			if(receive(true) < 0)
+				return -1;
+			continue;
+		}
+
+		if((!m_offset) && m_lost[m_next]) {
+			m_index += m_lost[m_next];
+			m_lost[m_next] = 0;
+			if(gaps)
+				(*gaps)++;
+		}
+
+		n = m_samples[m_next] - m_offset;
+		if(n > len - taken)
+			n = len - taken;
+		if(keep) {
+			c = input_buffer(&n);
+			if(!n)
+				break;
+			{
+				profile_timer pt(PROF_CONVERT, n);
+
+				udp_convert(m_payload[m_next] + m_offset *
+				   ((m_format == FORMAT_FC32)? 8 : 4), c, n,
+				   m_format, m_framing == FRAMING_VITA);
+			}
+			commit(n, true, m_index / (double)m_device_rate);
+		}
+		m_offset += n;
+		m_index += n;
+		taken += n;
+		if(m_offset == m_samples[m_next]) {
+			m_next++;
+			m_offset = 0;
+		}
+	}
+
+	return taken;
+}
+
+
+int udp_source::fill(unsigned int num_samples, unsigned int *overrun) {
+
+	unsigned int gaps = 0;
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	while((m_cb->data_available() < num_samples) &&
+	   (m_cb->space_available() > 0)) {
+		if(take(m_recv_samples_per_packet, true, &gaps) < 0)
+			return -1;
+	}
+
+	if(overrun)
+		*overrun = gaps;
+
+	return 0;
+}
+
+
+/*
+ * There is no asking a remote front-end for samples at a time, so this
+ * waits for the stream to get there.  A gap that jumps past when counts
+ * as being late.
+ */
+int udp_source::capture(double when, unsigned int num_samples, unsigned int *overrun) {
+
+	unsigned long long start;
+	unsigned int num_device, gaps = 0;
+	int r;
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	if(overrun)
+		*overrun = 0;
+
+	m_streaming = false;
+	if(m_cb->space_available() < num_samples) {
+		fprintf(stderr, "error: udp_source::capture: no space\n");
+		return -1;
+	}
+
+	num_device = device_samples(num_samples, &when);
+	start = (unsigned long long)ceil(when * m_device_rate);
+	while(m_index < start) {
+		r = take((start - m_index < m_recv_samples_per_packet)?
+		   start - m_index : m_recv_samples_per_packet, false, &gaps);
+		if(r < 0)
+			return -1;
+	}
+	if(m_index > start)
+		return 1;
+
+	while(num_device) {
+		if((r = take(num_device, true, &gaps)) < 0)
+			return -1;
+		if(!r)
+			break;
+		num_device -= r;
+	}
+
+	if(overrun)
+		*overrun = gaps;
+
+	return 0;
+}
+
+
+int udp_source::tune(double freq) {
+
+	profile_timer pt(PROF_TUNE);
+
+	return (int)freq;
+}
+
+
+void udp_source::set_antenna(int antenna) {
+
+}
+
+
+void udp_source::set_antenna(const std::string antenna) {
+
+}
+
+
+std::vector<std::string> udp_source::get_antennas() {
+
+	return std::vector<std::string>(1, "RX2");
+}
+
+
+bool udp_source::set_gain(float gain) {
+
+	return (0.0 <= gain) && (gain <= 1.0);
+}
+
+
+bool udp_source::has_gain() {
+
+	return false;
+}
+
+
+/*
+ * Whatever queued up while nobody was reading is stale, but it still
+ * counts towards the device clock.
+ */
+void udp_source::start() {
+
+	unsigned int i;
+	int n;
+
+	do {
+		if((n = receive(false)) < 0)
+			break;
+		for(i = 0; i < m_count; i++)
+			m_index += m_lost[i] + m_samples[i];
+	} while(n == (int)BATCH);
+	m_count = 0;
+
+	m_streaming = true;
+}
+
+
+void udp_source::stop() {
+
+	m_streaming = false;
+}
+
+
+double udp_source::time_now() {
+
+	return m_index / (double)m_device_rate;
+}
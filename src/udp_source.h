@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2010, Joshua Lackey
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     *  Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *     *  Redistributions in binary form must reproduce the above copyright
+ *        notice, this list of conditions and the following disclaimer in the
+ *        documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * udp_source
+ *
+ * Receives samples streamed over UDP by a remote front-end in place of
+ * the USRP.  Selected with device arguments starting with "udp=", for
+ * example
+ *
+ *	udp=5000,format=sc16,framing=vita,rate=1083333.333
+ *
+ * udp= is the port to listen on, optionally preceded by the IPv4 address
+ * to bind, as in udp=10.0.0.1:5000.  format is sc16 (interleaved 16-bit
+ * I/Q, the default) or fc32 (interleaved floats).  rate is the rate the
+ * front-end sends at and defaults to the rate kal asks for.  framing is
+ * one of
+ *
+ *	raw	the datagram is nothing but samples in host byte order (the
+ *		default).  Lost datagrams can't be noticed.
+ *	seq	each datagram starts with a 64-bit sequence number in host
+ *		byte order, as sent by GNU Radio's UDP sink.
+ *	vita	VITA-49 IF data packets, samples in network byte order.  The
+ *		4-bit packet count gives the sequence; context packets are
+ *		ignored.
+ *
+ * A gap in the sequence is reported as an overrun and the samples lost
+ * are skipped, so the device clock, which is the sample count as with
+ * sim_source, keeps following the sender.  Datagrams are received in
+ * batches with recvmmsg() where there is one.  Tuning and gain belong to
+ * the front-end and are ignored here.
+ */
+
+#pragma once
+
+#include "usrp_source.h"
+
+class udp_source : public usrp_source {
+public:
+	udp_source(float sample_rate, const std::string args);
+	~udp_source();
+
+	int open(unsigned int subdev);
+	int fill(unsigned int num_samples, unsigned int *overrun);
+	int capture(double when, unsigned int num_samples, unsigned int *overrun);
+	int tune(double freq);
+	void set_antenna(int antenna);
+	void set_antenna(const std::string antenna);
+	std::vector<std::string> get_antennas();
+	bool set_gain(float gain);
+	bool has_gain();
+	void start();
+	void stop();
+	double time_now();
+
+	enum {
+		FORMAT_SC16,
+		FORMAT_FC32
+	};
+
+	enum {
+		FRAMING_RAW,
+		FRAMING_SEQ,
+		FRAMING_VITA
+	};
+
+private:
+	static const unsigned int	BATCH		= 64;	// datagrams
+	static const unsigned int	PKT_LEN		= 9000;
+	static const int		RCVBUF		= 8 << 20;
+	static const int		IDLE_MAX	= 5;	// seconds
+
+	int receive(bool wait);
+	int parse(unsigned int i);
+	int take(unsigned int len, bool keep, unsigned int *gaps);
+
+	std::string			m_addr;
+	int				m_port,
+					m_format,
+					m_framing,
+					m_fd;
+	unsigned long long		m_index,	// samples delivered
+					m_seq;		// expected next
+	bool				m_have_seq,
+					m_bad_args;
+
+	/*
+	 * A batch of datagrams as received, and where we are in it.  Each
+	 * is parsed into the payload and its length in samples.
+	 */
+	unsigned char *			m_pkt;
+	struct mmsghdr *		m_msgs;
+	struct iovec *			m_iovs;
+	unsigned char *			m_payload[BATCH];
+	unsigned int			m_samples[BATCH],
+					m_lost[BATCH],	// before this one
+					m_count,	// datagrams in the batch
+					m_next,		// being taken from
+					m_offset;	// samples taken from it
+};
@@ -25,7 +25,21 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#pragma once
+
 #include <complex>
 
 typedef std::complex<float> complex;
 
+
+/*
+ * Converts len interleaved 16-bit I/Q pairs, as the device delivers them,
+ * to complex floats.
+ */
+static inline void sc16_to_fc32(const short *s, complex *c, const unsigned int len) {
+
+	unsigned int i, j;
+
+	for(i = 0, j = 0; i < len; i += 1, j += 2)
+		c[i] = complex(s[j], s[j + 1]);
+}
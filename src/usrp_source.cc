@@ -37,18 +37,33 @@
 #include <iostream>
 
 #include "usrp_source.h"
+#include "profile.h"
+#include "rt.h"
 
 extern int g_verbosity;
 
 
 usrp_source::usrp_source(float sample_rate,
 			long int fpga_master_clock_freq,
-			bool external_ref) {
+			bool external_ref,
+			const std::string args) {
 
 	m_desired_sample_rate = sample_rate;
 	m_fpga_master_clock_freq = fpga_master_clock_freq;
 	m_external_ref = external_ref;
+	m_args = args;
 	m_sample_rate = 0.0;
+	m_device_rate = 0.0;
+	m_output_rate = 0.0;
+	m_resampler = 0;
+	m_rbuf = 0;
+	m_rbuf_len = 0;
+	m_in_timed = false;
+	m_in_next = 0.0;
+	m_streaming = false;
+	m_recv_samples_per_packet = 0;
+	m_segment_count = 0;
+	m_sample_count = 0;
 	m_dev.reset();
 	m_cb = new circular_buffer(CB_LEN, sizeof(complex), 0);
 
@@ -60,6 +75,8 @@ usrp_source::~usrp_source() {
 
 	stop();
 	delete m_cb;
+	delete m_resampler;
+	delete[] m_rbuf;
 	pthread_mutex_destroy(&m_u_mutex);
 }
 
@@ -71,6 +88,7 @@ void usrp_source::stop() {
 		uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS);
 		m_dev->issue_stream_cmd(cmd);
 	}
+	m_streaming = false;
 	pthread_mutex_unlock(&m_u_mutex);
 }
 
@@ -82,6 +100,7 @@ void usrp_source::start() {
 		uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_START_CONTINUOUS);
 		m_dev->issue_stream_cmd(cmd);
 	}
+	m_streaming = true;
 	pthread_mutex_unlock(&m_u_mutex);
 }
 
@@ -92,9 +111,200 @@ float usrp_source::sample_rate() {
 }
 
 
+float usrp_source::device_rate() {
+
+	return m_device_rate;
+}
+
+
+/*
+ * Resample whatever rate the device ends up at to rate.  Must be called
+ * before open().
+ */
+void usrp_source::set_output_rate(double rate) {
+
+	m_output_rate = rate;
+}
+
+
+/*
+ * Called by open() once m_device_rate is known.
+ */
+void usrp_source::resample_setup() {
+
+	m_sample_rate = m_device_rate;
+	if((m_output_rate <= 0.0) || m_resampler)
+		return;
+
+	m_resampler = new resampler(m_device_rate, m_output_rate);
+	m_sample_rate = m_resampler->out_rate();
+
+	if(g_verbosity > 1) {
+		fprintf(stderr, "Resampling %f -> %f (%u/%u)\n",
+		   m_device_rate, m_sample_rate,
+		   m_resampler->interpolation(), m_resampler->decimation());
+	}
+}
+
+
+/*
+ * Where to put the next *len device samples.  Without a resampler *len is
+ * reduced to what the buffer can take; the resampler keeps any input it
+ * has no room to write out until the next commit().
+ */
+complex *usrp_source::input_buffer(unsigned int *len) {
+
+	unsigned int space;
+	complex *c;
+
+	if(!m_resampler) {
+		c = (complex *)m_cb->poke(&space);
+		if(*len > space)
+			*len = space;
+		return c;
+	}
+
+	if(m_rbuf_len < *len) {
+		delete[] m_rbuf;
+		m_rbuf_len = *len;
+		m_rbuf = new complex[m_rbuf_len];
+		rt_memory(m_rbuf, m_rbuf_len * sizeof(complex));
+	}
+
+	return m_rbuf;
+}
+
+
+/*
+ * Commits len device samples written to input_buffer().  t is the device
+ * time of the first.
+ */
+void usrp_source::commit(unsigned int len, bool has_time, double t) {
+
+	unsigned int space, n;
+	double lead;
+	complex *c;
+
+	if(!m_resampler) {
+		wrote(len, has_time, t);
+		return;
+	}
+
+	// a gap in the input invalidates the filter history
+	if(has_time && m_in_timed && (fabs(t - m_in_next) * m_device_rate > 0.5))
+		m_resampler->reset();
+	m_in_timed = has_time;
+	m_in_next = t + len / (double)m_device_rate;
+
+	lead = m_resampler->lead();
+	c = (complex *)m_cb->poke(&space);
+	{
+		profile_timer pt(PROF_CONVERT, len);
+		n = m_resampler->process(m_rbuf, len, c, space);
+	}
+	wrote(n, has_time, t + lead / m_device_rate);
+}
+
+
+/*
+ * Device samples to ask for so that num_samples land in the buffer
+ * starting at *when.  *when is moved earlier to cover the resampler's
+ * settling time.
+ */
+unsigned int usrp_source::device_samples(unsigned int num_samples, double *when) {
+
+	if(!m_resampler)
+		return num_samples;
+
+	*when -= m_resampler->settle() / m_device_rate;
+	return m_resampler->input_for(num_samples);
+}
+
+
+double usrp_source::time_now() {
+
+	double t;
+
+	pthread_mutex_lock(&m_u_mutex);
+	t = m_dev->get_time_now().get_real_secs();
+	pthread_mutex_unlock(&m_u_mutex);
+
+	return t;
+}
+
+
+unsigned long long usrp_source::sample_count() {
+
+	return m_sample_count;
+}
+
+
+/*
+ * Device time of the sample with the given index.  Returns -1 if the index
+ * is older than the segments we remember or was never timestamped.
+ */
+int usrp_source::sample_time(unsigned long long index, double *t) {
+
+	unsigned int i;
+	sample_segment *seg;
+
+	if(index >= m_sample_count)
+		return -1;
+
+	for(i = m_segment_count; i > 0; i--) {
+		seg = &m_segments[(i - 1) % SEGMENT_MAX];
+		if(seg->index <= index) {
+			if(m_segment_count - i >= SEGMENT_MAX)
+				return -1;
+			*t = seg->time + (index - seg->index) / (double)m_sample_rate;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
+/*
+ * Number of discontinuities since the last flush.
+ */
+unsigned int usrp_source::gap_count() {
+
+	return m_segment_count? m_segment_count - 1 : 0;
+}
+
+
+/*
+ * Commits len samples written at poke() and starts a new segment if t
+ * doesn't follow on from the last one.
+ */
+void usrp_source::wrote(unsigned int len, bool has_time, double t) {
+
+	sample_segment *seg;
+	double expected;
+	profile_timer pt(PROF_RING, len);
+
+	if(has_time) {
+		if(m_segment_count) {
+			seg = &m_segments[(m_segment_count - 1) % SEGMENT_MAX];
+			expected = seg->time + (m_sample_count - seg->index) / (double)m_sample_rate;
+		}
+		if((!m_segment_count) || (fabs(t - expected) * m_sample_rate > 0.5)) {
+			seg = &m_segments[m_segment_count++ % SEGMENT_MAX];
+			seg->index = m_sample_count;
+			seg->time = t;
+		}
+	}
+
+	m_cb->wrote(len);
+	m_sample_count += len;
+}
+
+
 int usrp_source::tune(double freq) {
 
 	double actual_freq;
+	profile_timer pt(PROF_TUNE);
 
 	pthread_mutex_lock(&m_u_mutex);
 	m_dev->set_rx_freq(freq);
@@ -127,6 +337,15 @@ std::vector<std::string> usrp_source::get_antennas() {
 }
 
 
+/*
+ * Whether set_gain() changes what is received, so the gain can be ranged.
+ */
+bool usrp_source::has_gain() {
+
+	return true;
+}
+
+
 bool usrp_source::set_gain(float gain) {
 
 	uhd::gain_range_t gain_range = m_dev->get_rx_gain_range();
@@ -147,14 +366,15 @@ bool usrp_source::set_gain(float gain) {
 int usrp_source::open(unsigned int subdev) {
 
 	if(!m_dev) {
-		uhd::device_addr_t dev_addr("type=usrp2");
+		uhd::device_addr_t dev_addr(m_args);
 		if (!(m_dev = uhd::usrp::single_usrp::make(dev_addr))) {
 			fprintf(stderr, "error: single_usrp::make: failed!\n");
 			return -1;
 		}
 
 		m_dev->set_rx_rate(m_desired_sample_rate);
-		m_sample_rate = m_dev->get_rx_rate();
+		m_device_rate = m_dev->get_rx_rate();
+		resample_setup();
 
 		uhd::clock_config_t clock_config;
 		clock_config.pps_source = uhd::clock_config_t::PPS_SMA;
@@ -214,14 +434,55 @@ std::string handle_rx_err(uhd::rx_metadata_t metadata, bool &overrun) {
 	return ost.str();
 }
 
-int usrp_source::fill(unsigned int num_samples, unsigned int *overrun) {
+/*
+ * Receives one packet and, if keep is set, converts it into the buffer.
+ * Returns the number of device samples kept.
+ */
+int usrp_source::recv_packet(unsigned char *ubuf, double timeout,
+   uhd::rx_metadata_t &metadata, bool keep) {
 
-	unsigned char ubuf[m_recv_samples_per_packet * 2 * sizeof(short)];
 	short *s = (short *)ubuf;
-	unsigned int i, j, space, overrun_cnt;
+	unsigned int len;
+	size_t samples_read;
 	complex *c;
+
+	pthread_mutex_lock(&m_u_mutex);
+	samples_read = m_dev->get_device()->recv((void*)ubuf,
+				m_recv_samples_per_packet,
+				metadata,
+				uhd::io_type_t::COMPLEX_INT16,
+				uhd::device::RECV_MODE_ONE_PACKET,
+				timeout);
+	pthread_mutex_unlock(&m_u_mutex);
+
+	if(!keep)
+		return 0;
+
+	// write complex<short> input to complex<float> output
+	len = samples_read;
+	c = input_buffer(&len);
+
+	// write data
+	{
+		profile_timer pt(PROF_CONVERT, len);
+		sc16_to_fc32(s, c, len);
+	}
+
+	// update cb
+	commit(len, metadata.has_time_spec, metadata.time_spec.get_real_secs());
+
+	return len;
+}
+
+
+int usrp_source::fill(unsigned int num_samples, unsigned int *overrun) {
+
+	unsigned char ubuf[m_recv_samples_per_packet * 2 * sizeof(short)];
+	unsigned int overrun_cnt;
 	bool overrun_pkt;
 
+	profile_timer pt(PROF_FILL, num_samples);
+
 	overrun_cnt = 0;
 
 	while ((m_cb->data_available() < num_samples)
@@ -229,37 +490,16 @@ int usrp_source::fill(unsigned int num_samples, unsigned int *overrun) {
 
 		uhd::rx_metadata_t metadata;
 
-		pthread_mutex_lock(&m_u_mutex);
-		size_t samples_read = m_dev->get_device()->recv((void*)ubuf,
-					m_recv_samples_per_packet,
-					metadata,
-					uhd::io_type_t::COMPLEX_INT16,
-					uhd::device::RECV_MODE_ONE_PACKET);
-		pthread_mutex_unlock(&m_u_mutex);
-
-		if (samples_read < m_recv_samples_per_packet) {
+		recv_packet(ubuf, RECV_TIMEOUT, metadata, true);
+		if (metadata.error_code != uhd::rx_metadata_t::ERROR_CODE_NONE) {
 			std::string err_str = handle_rx_err(metadata, overrun_pkt);
 			if (overrun_pkt) {
 				overrun_cnt++;
 			} else {
-				fprintf(stderr, err_str.c_str());
+				fprintf(stderr, "%s\n", err_str.c_str());
 				return -1;
 			}
 		}
-
-		// write complex<short> input to complex<float> output
-		c = (complex *)m_cb->poke(&space);
-
-		// set space to number of complex items to copy
-		if(space > m_recv_samples_per_packet)
-			space = m_recv_samples_per_packet;
-
-		// write data
-		for(i = 0, j = 0; i < space; i += 1, j += 2)
-			c[i] = complex(s[j], s[j + 1]);
-
-		// update cb
-		m_cb->wrote(i);
 	}
 
 	// if the cb is full, we left behind data from the usb packet
@@ -274,6 +514,76 @@ int usrp_source::fill(unsigned int num_samples, unsigned int *overrun) {
 }
 
 
+/*
+ * Receives num_samples starting at device time when and appends them to
+ * the buffer.  Continuous streaming is stopped first.  Returns 1 if when had
+ * already passed, 0 on success and -1 on error.
+ */
+int usrp_source::capture(double when, unsigned int num_samples, unsigned int *overrun) {
+
+	unsigned char ubuf[m_recv_samples_per_packet * 2 * sizeof(short)];
+	unsigned int got = 0, overrun_cnt = 0, num_device;
+	double timeout;
+	bool overrun_pkt;
+
+	profile_timer pt(PROF_FILL, num_samples);
+
+	if(overrun)
+		*overrun = 0;
+
+	// stop and drain the continuous stream
+	if(m_streaming) {
+		stop();
+		for(;;) {
+			uhd::rx_metadata_t metadata;
+			recv_packet(ubuf, RECV_TIMEOUT, metadata, false);
+			if(metadata.error_code == uhd::rx_metadata_t::ERROR_CODE_TIMEOUT)
+				break;
+		}
+	}
+
+	if(m_cb->space_available() < num_samples) {
+		fprintf(stderr, "error: usrp_source::capture: no space\n");
+		return -1;
+	}
+
+	num_device = device_samples(num_samples, &when);
+
+	uhd::stream_cmd_t cmd(uhd::stream_cmd_t::STREAM_MODE_NUM_SAMPS_AND_DONE);
+	cmd.num_samps = num_device;
+	cmd.stream_now = false;
+	cmd.time_spec = uhd::time_spec_t(when);
+	pthread_mutex_lock(&m_u_mutex);
+	m_dev->issue_stream_cmd(cmd);
+	pthread_mutex_unlock(&m_u_mutex);
+
+	timeout = when - time_now() + RECV_TIMEOUT;
+	while(got < num_device) {
+		uhd::rx_metadata_t metadata;
+
+		got += recv_packet(ubuf, timeout, metadata, true);
+		timeout = RECV_TIMEOUT;
+
+		if(metadata.error_code == uhd::rx_metadata_t::ERROR_CODE_NONE)
+			continue;
+		if(metadata.error_code == uhd::rx_metadata_t::ERROR_CODE_LATE_COMMAND)
+			return 1;
+		std::string err_str = handle_rx_err(metadata, overrun_pkt);
+		if(!overrun_pkt) {
+			fprintf(stderr, "%s\n", err_str.c_str());
+			return -1;
+		}
+		overrun_cnt++;
+		break;
+	}
+
+	if(overrun)
+		*overrun = overrun_cnt;
+
+	return 0;
+}
+
+
 int usrp_source::read(complex *buf, unsigned int num_samples, unsigned int *samples_read) {
 
 	unsigned int n;
@@ -299,11 +609,24 @@ circular_buffer *usrp_source::get_buffer() {
 }
 
 
+/*
+ * Whether the stream has ended for good, as a recording does.
+ */
+bool usrp_source::exhausted() {
+
+	return false;
+}
+
+
 int usrp_source::flush(unsigned int flush_count) {
 
+	profile_timer pt(PROF_FLUSH);
+
 	m_cb->flush();
 	fill(flush_count * m_recv_samples_per_packet * 2 * sizeof(short), 0);
 	m_cb->flush();
+	m_sample_count = 0;
+	m_segment_count = 0;
 
 	return 0;
 }
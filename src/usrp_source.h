@@ -25,56 +25,114 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#pragma once
+
 #include <uhd/usrp/single_usrp.hpp>
 
 #include "usrp_complex.h"
 #include "circular_buffer.h"
+#include "resampler.h"
+
+
+/*
+ * Samples written to the buffer since the last flush are numbered from 0.
+ * Each time the device timestamps stop following on from the previous
+ * sample (start of stream, overrun, timed capture) a new segment is
+ * recorded, so the device time of any recent sample can be recovered and
+ * gaps between capture windows are known.
+ */
+struct sample_segment {
+	unsigned long long	index;
+	double			time;
+};
 
 
 class usrp_source {
 public:
 	usrp_source(float sample_rate,
 		long int fpga_master_clock_freq = 100000000,
-		bool external_ref = false);
+		bool external_ref = false,
+		const std::string args = "type=usrp2");
 
-	~usrp_source();
+	virtual ~usrp_source();
 
-	int open(unsigned int subdev);
+	virtual int open(unsigned int subdev);
 	int read(complex *buf,
 		unsigned int num_samples,
 		unsigned int *samples_read);
 
-	int fill(unsigned int num_samples, unsigned int *overrun);
-	int tune(double freq);
-	void set_antenna(int antenna);
-	void set_antenna(const std::string antenna);
-	std::vector<std::string> get_antennas();
-	bool set_gain(float gain);
-	void start();
-	void stop();
-	int flush(unsigned int flush_count = FLUSH_COUNT);
+	virtual int fill(unsigned int num_samples, unsigned int *overrun);
+	virtual int capture(double when, unsigned int num_samples, unsigned int *overrun);
+	virtual int tune(double freq);
+	virtual void set_antenna(int antenna);
+	virtual void set_antenna(const std::string antenna);
+	virtual std::vector<std::string> get_antennas();
+	virtual bool set_gain(float gain);
+	virtual bool has_gain();
+	virtual void start();
+	virtual void stop();
+	virtual double time_now();
+	virtual bool exhausted();
+	virtual int flush(unsigned int flush_count = FLUSH_COUNT);
 	circular_buffer *get_buffer();
 
+	void set_output_rate(double rate);
 	float sample_rate();
+	float device_rate();
+	unsigned long long sample_count();
+	int sample_time(unsigned long long index, double *t);
+	unsigned int gap_count();
 
-private:
-	uhd::usrp::single_usrp::sptr	m_dev;
+protected:
+	static const unsigned int	FLUSH_COUNT	= 10;
+
+	void resample_setup();
+	complex *input_buffer(unsigned int *len);
+	void commit(unsigned int len, bool has_time, double t);
+	unsigned int device_samples(unsigned int num_samples, double *when);
+	void wrote(unsigned int len, bool has_time, double t);
 
 	float				m_sample_rate;
+	float				m_device_rate;
 	float				m_desired_sample_rate;
-	bool				m_external_ref;
+	double				m_output_rate;
+	std::string			m_args;
+	bool				m_streaming;
 	unsigned int			m_recv_samples_per_packet;
-	long int			m_fpga_master_clock_freq;
 
 	circular_buffer *		m_cb;
 
+	/*
+	 * With an output rate set, device samples are converted into
+	 * m_rbuf and resampled into the buffer.  m_sample_rate is then the
+	 * resampled rate and m_device_rate what the device delivers.
+	 */
+	resampler *			m_resampler;
+	complex *			m_rbuf;
+	unsigned int			m_rbuf_len;
+	bool				m_in_timed;
+	double				m_in_next;
+
+	static const unsigned int	SEGMENT_MAX	= 64;
+	sample_segment			m_segments[SEGMENT_MAX];
+	unsigned int			m_segment_count;
+	unsigned long long		m_sample_count;
+
+private:
+	int recv_packet(unsigned char *ubuf, double timeout, uhd::rx_metadata_t &metadata, bool keep);
+
+	uhd::usrp::single_usrp::sptr	m_dev;
+
+	bool				m_external_ref;
+	long int			m_fpga_master_clock_freq;
+
 	/*
 	 * This mutex protects access to the USRP and daughterboards but not
 	 * necessarily to any fields in this class.
 	 */
 	pthread_mutex_t			m_u_mutex;
 
-	static const unsigned int	FLUSH_COUNT	= 10;
+	static const double		RECV_TIMEOUT	= 0.1;
 	static const unsigned int	CB_LEN		= (1 << 20);
 	static const int		NCHAN		= 1;
 };
@@ -29,6 +29,8 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "util.h"
+
 
 void display_freq(float f) {
 
@@ -62,35 +64,16 @@ void display_freq(float f) {
 }
 
 
-void sort(float *b, unsigned int len) {
-
-	for(unsigned int i = 0; i < len; i++) {
-		for(unsigned int j = i + 1; j < len; j++) {
-			if(b[j] < b[i]) {
-				float t = b[i];
-				b[i] = b[j];
-				b[j] = t;
-			}
-		}
-	}
-}
-
-
-double avg(float *b, unsigned int len, float *stddev) {
+/*
+ * Energy of the len samples in v.
+ */
+double vectornorm2(const complex *v, const unsigned int len) {
 
 	unsigned int i;
-	double t = 0.0, a = 0.0, s = 0.0;
+	double e = 0.0;
 
 	for(i = 0; i < len; i++)
-		t += b[i];
-	a = t / len;
-	if(stddev) {
-		for(i = 0; i < len; i++)
-			s += (b[i] - a) * (b[i] - a);
-		s /= len;
-		s = sqrt(s);
-		*stddev = s;
-	}
+		e += norm(v[i]);
 
-	return a;
+	return e;
 }
@@ -25,6 +25,12 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#pragma once
+
+#include "usrp_complex.h"
+
+// GSM symbol rate
+static const double GSM_RATE = 1625000.0 / 6.0;
+
 void display_freq(float f);
-void sort(float *b, unsigned int len);
-double avg(float *b, unsigned int len, float *stddev);
+double vectornorm2(const complex *v, const unsigned int len);